@@ -0,0 +1,80 @@
+#ifndef CPP_NETWORKING_BUFFER_POOL_H
+#define CPP_NETWORKING_BUFFER_POOL_H
+
+/* Buffer_Pool
+ *
+ * Overview:
+ * A pool of reusable streambufs shared by Tcp connections and server sessions.
+ *
+ * Behavior:
+ * Buffers are grouped into fixed size slab classes, one per configured chunk size. acquire()
+ * hands out an empty buffer from the smallest class that fits the requested size. When the
+ * last reference to a buffer is released its data is consumed and the buffer goes back onto
+ * the free list of the releasing thread, keeping its capacity. Once warmed up a thread that
+ * acquires and releases buffers performs no heap allocations.
+ *
+ * Free lists are per thread so no lock is taken on the hot path. Every thread caches at most
+ * max_cached_per_thread buffers per class and buffers that grew beyond the largest chunk size
+ * are freed instead of cached, which bounds the memory held by idle buffers.
+ *
+ * Call Buffer_Pool::get() for the process wide pool used by Tcp and Tcp_Base_Session. A pool
+ * must outlive every buffer acquired from it. Buffers a thread cached for a destroyed pool are
+ * freed when that thread exits.
+ *
+ */
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+namespace net
+{
+
+class Buffer_Pool
+{
+    public:
+        using Buffer_t = std::shared_ptr<boost::asio::streambuf>;
+
+        // chunk_sizes must be non empty and are sorted into ascending order.
+        Buffer_Pool(std::vector<size_t> chunk_sizes, size_t max_cached_per_thread);
+
+        // The process wide pool used by Tcp and Tcp_Base_Session.
+        static Buffer_Pool& get();
+
+        // Returns an empty buffer with room for at least size_hint bytes before it has to grow.
+        // Requests larger than the largest chunk size are served by an unpooled buffer.
+        Buffer_t acquire(size_t size_hint = 0);
+
+        // Number of free buffers cached by the calling thread.
+        size_t cached();
+
+        const std::vector<size_t>& get_chunk_sizes() const
+            { return chunk_sizes; }
+
+    private:
+        // Free lists indexed by slab class.
+        using Free_Lists_t = std::vector<std::vector<std::unique_ptr<boost::asio::streambuf>>>;
+
+        // Returns the free lists the calling thread keeps for this pool.
+        Free_Lists_t& thread_free_lists();
+
+        // Index of the smallest class whose chunk size is at least size.
+        size_t class_for(size_t size) const;
+
+        // Shared pointer deleter returning the buffer to the releasing thread's free list.
+        void release(boost::asio::streambuf* buf);
+
+        const std::vector<size_t> chunk_sizes;
+        const size_t max_cached_per_thread;
+
+        // Distinguishes this pool's free lists from those of other (possibly destroyed) pools.
+        const uint64_t id;
+
+}; // Buffer_Pool
+
+} // net
+
+#endif
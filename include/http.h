@@ -10,6 +10,7 @@
 
 #include "boost_config.h"
 #include <boost/asio.hpp>
+#include <boost/asio/spawn.hpp>
 #include <boost/thread/future.hpp>
 
 /* Http
@@ -28,23 +29,38 @@
  * - Request interfaces assume that the caller will preserve sent data until response
  * is received.
  * - Header interfaces copy values into the client.
+ * - Every method also has a coroutine variant taking a boost::asio::yield_context. It waits
+ * for a pooled connection, sends the request and reads the status line, headers, and body one
+ * after the other, suspending the calling coroutine in between, and throws a system_error on
+ * failure. The body is read using the Content-Length header, or until the server closes the
+ * connection when there is none. A connection only goes back to the pool once its response
+ * was read completely, otherwise it is closed.
+ * - Header names are compared case-insensitively.
  *
  */
 
 // Settings
 // XXX should probably be moved to a file and read in
-const char* http_version_c = "HTTP/1.1";
-const char* http_service_c = "http";
-const char* https_service_c = "https";
+const char* const http_version_c = "HTTP/1.1";
+const char* const http_service_c = "http";
+const char* const https_service_c = "https";
 const boost::posix_time::time_duration default_timeout_c = boost::posix_time::seconds(240);
 
 namespace net {
 
+// Orders header names ignoring case.
+struct Header_Name_Less
+{
+    bool operator()(const std::string& a, const std::string& b) const;
+};
+
+using Headers_t = std::map<std::string, std::string, Header_Name_Less>;
+
 struct Http_Response
 {
     std::string status;
-    std::map<std::string, std::string> headers;
-    boost::asio::const_buffer body;
+    Headers_t headers;
+    std::string body;
 };
 
 class Http
@@ -82,6 +98,19 @@ class Http
 
         boost::future<Http_Response> patch(const std::string& path, const std::string& body);
 
+        // Coroutine variants. See Design above.
+        Http_Response get(const std::string& path, boost::asio::yield_context);
+        Http_Response head(const std::string& path, boost::asio::yield_context);
+        Http_Response post(const std::string& path, const std::string& body,
+                           boost::asio::yield_context);
+        Http_Response put(const std::string& path, const std::string& body,
+                          boost::asio::yield_context);
+        Http_Response delet(const std::string& path, boost::asio::yield_context);
+        Http_Response trace(const std::string& path, boost::asio::yield_context);
+        Http_Response options(const std::string& path, boost::asio::yield_context);
+        Http_Response patch(const std::string& path, const std::string& body,
+                            boost::asio::yield_context);
+
         // Header values are copied into the HTTP client so the caller doesn't need to
         // worry about preserving them
         void add_header(const std::string& name, const std::string& value)
@@ -91,17 +120,25 @@ class Http
         void reset_headers()
             { headers.clear(); }
 
+        // Caps the connections to 'host', see Tcp_Pool::set_max_connections(). Coroutine
+        // requests wait for a connection without blocking their thread.
+        void set_max_connections(size_t max_connections)
+            { tcp_pool->set_max_connections(max_connections); }
+
     private:
-        const std::string& host;
-        const std::string& service;
-        const std::string& http_version;
+        const std::string host;
+        const std::string service;
+        const std::string http_version;
 
         std::shared_ptr<Tcp_Pool> tcp_pool;
-        std::map<std::string, std::string> headers;
+        Headers_t headers;
 
         boost::future<Http_Response> request(const std::string& method,
                 const std::string& path, boost::asio::const_buffer& body);
 
+        Http_Response request(const std::string& method, const std::string& path,
+                              const std::string& body, boost::asio::yield_context yield);
+
         // Formats an HTTP message including the given method, path, and any set headers.
         std::string create_request_head(const std::string& method, const std::string& path);
 
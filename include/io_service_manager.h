@@ -11,21 +11,27 @@
  * Default: io_service object automatically stops once queued work is complete
  * Perpetual: io_service object must be manually stopped
  *
+ * Workers:
+ * The io_service is run by a group of worker threads. By default a single worker is
+ * used. Passing a worker count of zero sizes the group to the hardware concurrency.
+ * Handlers may execute concurrently on any worker so shared state must be guarded
+ * by a strand or a lock.
+ *
  * Design:
  * There are 4 states (constructing, destructing, running, stopped) with respective
  * functions to move between the states. State changes must be atomic given how many
  * threads are involved in io work.
  *
+ * A worker can't wait for itself to exit, so stop() refuses to run on one. The last
+ * reference may still be released by a handler, in which case that worker is left to exit
+ * on its own and keeps the io_service alive until it does.
+ *
  */
 
-// XXX Should this interface be modified to protect access from any worker thread?
-//     It could be an accidental call in a lambda it's executing such as closing a TCP connection
-//     which by default stops the Io_Service_Manager. Every function could be protected with
-//     a thread id check. If this_thread_id in Io_Service_Manager::set<thread::id>; throw.
-
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "boost_config.h"
 #include <boost/asio.hpp>
@@ -51,25 +57,33 @@ class Io_Service_Manager
         // Atomically changes the state depending on behavior
         Io_Service_Manager(Behavior_t);
 
-        // Blocks until completely stopped.
+        // Same as above but runs the io_service on num_workers threads. A value of
+        // 0 uses one worker per hardware thread.
+        Io_Service_Manager(Behavior_t, size_t num_workers);
+
+        // Blocks until completely stopped, except for the calling worker when destroyed by one.
         // Atomically changes the state to stopped then to destructing
         ~Io_Service_Manager();
 
-        // Start running the io_service. This runs one worker thread.
+        // Start running the io_service on all worker threads.
         // Throws logic_error if already started.
         // Atomically changes the state
         void start();
 
         // Stops the io_service and all worker threads.
-        // Throws logic_error if already stopped.
+        // Throws logic_error if already stopped, or if called by one of the workers.
         // Atomically changes the state
         void stop();
 
         boost::asio::io_service& get()
-            { return io_service; }
+            { return *io_service; }
 
         boost::asio::io_service::strand create_strand()
-        { return boost::asio::io_service::strand(io_service); }
+        { return boost::asio::io_service::strand(*io_service); }
+
+        // True when called by one of the workers, ex. from a handler.
+        bool in_worker_thread()
+            { return io_service->get_executor().running_in_this_thread(); }
 
         bool is_running()
             { return state == State_t::Running; }
@@ -77,6 +91,13 @@ class Io_Service_Manager
         bool is_perpetual()
             { return behavior == Behavior_t::Perpetual; }
 
+        size_t worker_count()
+            { return num_workers; }
+
+        // Pin every worker thread to a CPU. Applies to running workers and to workers
+        // started later. Only supported on linux; elsewhere this logs and does nothing.
+        void pin_workers(unsigned cpu);
+
         void block_until_stopped();
         void block_until_running();
 
@@ -87,7 +108,9 @@ class Io_Service_Manager
             Stopped,
         };
 
-        void run_worker();
+        // Runs service until it stops. Takes its own reference since a worker may destroy the
+        // manager from a handler.
+        static void run_worker(std::shared_ptr<boost::asio::io_service> service);
 
         // Changes to the start state. Only call this with the state change lock acquired.
         void to_start_state();
@@ -95,12 +118,20 @@ class Io_Service_Manager
         // Changes to the stop state. Only call this with the state change lock acquired.
         void to_stop_state();
 
+        // Joins every worker thread. Skips the calling thread if it is a worker.
+        void join_workers();
+
+        // Applies cpu_affinity to a worker. Only call this with the state change lock acquired.
+        void apply_cpu_affinity(boost::thread& worker);
+
         Behavior_t behavior;
         State_t state;
+        const size_t num_workers;
+        int cpu_affinity; // -1 when workers are not pinned
 
-        boost::asio::io_service io_service;
+        std::shared_ptr<boost::asio::io_service> io_service; // shared with the workers
         std::shared_ptr<boost::asio::io_service::work> io_work;
-        std::shared_ptr<boost::thread> io_thread_worker;
+        std::vector<std::shared_ptr<boost::thread>> io_thread_workers;
 
         // Locks
         std::mutex state_change_lock;
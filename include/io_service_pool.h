@@ -0,0 +1,96 @@
+#ifndef CPP_NETWORKING_IO_SERVICE_POOL_H
+#define CPP_NETWORKING_IO_SERVICE_POOL_H
+
+/* Io_Service_Pool
+ *
+ * Overview:
+ * This class runs a sharded set of Io_Service_Managers, one io_service per core, and
+ * places new connections onto them.
+ *
+ * Behavior:
+ * Every shard is a perpetual Io_Service_Manager with exactly one worker thread which is
+ * optionally pinned to its own CPU, taken from the CPUs the process may run on. Because
+ * each io_service is only ever run by one thread handlers for a connection never migrate
+ * between cores and never contend on a strand.
+ * Call next() to get the shard a new Tcp client or accepted socket should live on, or
+ * place() to put one on a given shard.
+ *
+ * Objects placed on a shard hold a shared pointer to it so its io_service outlives their
+ * sockets. Destroying the pool stops every shard, so destroy clients placed on the pool
+ * before the pool itself.
+ *
+ * Placement:
+ * Round_Robin: shards are handed out in order.
+ * Least_Loaded: the shard with the fewest objects placed on it is handed out.
+ *
+ * Every placement returned by next() or place() counts once in the load of its shard until
+ * the placement and all of its copies are released. Shard pointers from get() aren't counted.
+ *
+ */
+
+#include "io_service_manager.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace net
+{
+
+class Io_Service_Pool
+{
+    public:
+        enum class Placement_t
+        {
+            Round_Robin,
+            Least_Loaded,
+        };
+
+        // Create one pinned, round robin shard per hardware thread.
+        Io_Service_Pool();
+
+        // Create num_shards shards. A value of 0 uses one shard per CPU the process may run on.
+        // When pin_workers is set shard i runs on the i-th of those CPUs, modulo their number.
+        Io_Service_Pool(size_t num_shards, Placement_t placement, bool pin_workers);
+
+        // Stops every shard.
+        ~Io_Service_Pool();
+
+        // Pick the shard for a new connection according to the placement policy.
+        std::shared_ptr<Io_Service_Manager> next();
+
+        // Place a new connection on shard i.
+        std::shared_ptr<Io_Service_Manager> place(size_t i);
+
+        std::shared_ptr<Io_Service_Manager> get(size_t i)
+            { return shards.at(i)->service; }
+
+        size_t size()
+            { return shards.size(); }
+
+        // Number of objects currently placed on shard i.
+        size_t load(size_t i)
+            { return shards.at(i)->load; }
+
+    private:
+        // Placements hold a reference to their shard so they can uncount themselves after
+        // the pool is gone.
+        struct Shard
+        {
+            std::shared_ptr<Io_Service_Manager> service;
+            std::atomic<size_t> load;
+        };
+
+        // CPUs the process may run on, in increasing order. Never empty.
+        static std::vector<unsigned> allowed_cpus();
+
+        const Placement_t placement;
+
+        std::vector<std::shared_ptr<Shard>> shards;
+        std::atomic<size_t> next_shard;
+
+}; // Io_Service_Pool
+
+} // net
+
+#endif
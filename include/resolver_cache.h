@@ -0,0 +1,99 @@
+#ifndef CPP_NETWORKING_RESOLVER_CACHE_H
+#define CPP_NETWORKING_RESOLVER_CACHE_H
+
+/* Resolver_Cache
+ *
+ * Overview:
+ * A thread safe cache of resolved host / service endpoints shared by every Tcp connection.
+ *
+ * Behavior:
+ * Successful resolutions are cached for ttl and failed resolutions for negative_ttl, except
+ * for cancelled ones which say nothing about the host. Connection churn to the same host
+ * only calls getaddrinfo() once per ttl. The cache holds at most max_entries entries and
+ * evicts the least recently used entry when full.
+ *
+ * Call Resolver_Cache::get() for the process wide cache that Tcp consults before resolving.
+ * Connections that fail on every cached endpoint invalidate the entry so the next connection
+ * resolves again.
+ *
+ */
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace net
+{
+
+class Resolver_Cache
+{
+    public:
+        using Endpoints_t = std::vector<boost::asio::ip::tcp::endpoint>;
+
+        Resolver_Cache(boost::posix_time::time_duration ttl,
+                       boost::posix_time::time_duration negative_ttl,
+                       size_t max_entries);
+
+        // The process wide cache used by Tcp.
+        static Resolver_Cache& get();
+
+        // Returns true on a hit. On a negative hit ec is set to the cached error and
+        // endpoints is left empty.
+        bool lookup(const std::string& host, const std::string& service,
+                    Endpoints_t& endpoints, boost::system::error_code& ec);
+
+        void insert(const std::string& host, const std::string& service,
+                    const Endpoints_t& endpoints);
+        // Does nothing when ec is operation_aborted, the lookup was only cancelled.
+        void insert_error(const std::string& host, const std::string& service,
+                          const boost::system::error_code& ec);
+
+        void invalidate(const std::string& host, const std::string& service);
+        void clear();
+
+        // Consults the cache and falls back to a blocking resolve on a miss.
+        // XXX blocking
+        Endpoints_t resolve(boost::asio::io_service& io_service,
+                            const std::string& host, const std::string& service,
+                            boost::system::error_code& ec);
+
+        size_t size();
+
+    private:
+        // Host and service. Kept apart since IPv6 literals contain colons.
+        using Key_t = std::pair<std::string, std::string>;
+
+        struct Entry
+        {
+            Key_t key;
+            Endpoints_t endpoints;
+            boost::system::error_code error;
+            boost::posix_time::ptime expires_at;
+        };
+
+        using Lru_t = std::list<Entry>;
+
+        // Stores entry as the most recently used. Only call this with the lock acquired.
+        void store(Entry entry);
+
+        const boost::posix_time::time_duration ttl;
+        const boost::posix_time::time_duration negative_ttl;
+        const size_t max_entries;
+
+        // Most recently used entry first.
+        Lru_t entries;
+        std::map<Key_t, Lru_t::iterator> index;
+        std::mutex entries_lock;
+
+}; // Resolver_Cache
+
+} // net
+
+#endif
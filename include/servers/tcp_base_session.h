@@ -1,6 +1,8 @@
 #ifndef CPP_NETWORKING_TCP_SESSION_BASE_H
 #define CPP_NETWORKING_TCP_SESSION_BASE_H
 
+#include "io_service_manager.h"
+
 #include <memory>
 
 #include "boost_config.h"
@@ -12,11 +14,28 @@ class Tcp_Base_Session : public std::enable_shared_from_this<Tcp_Base_Session>
 {
     public:
         Tcp_Base_Session(boost::asio::ip::tcp::socket socket_);
+
+        // Keeps the io_service owning socket_ alive for the lifetime of the session. Used
+        // when sockets are placed on Io_Service_Pool shards.
+        Tcp_Base_Session(boost::asio::ip::tcp::socket socket_,
+                         std::shared_ptr<Io_Service_Manager> io_service_);
         virtual ~Tcp_Base_Session() = 0;
 
         virtual void start() = 0;
 
+        // Tcp_Session_Pool hooks. recycle() closes the socket, releases the io_service and
+        // calls reset() so the session can be cached. reuse() hands a recycled session the
+        // next accepted socket, after which it is started like a new one.
+        void recycle();
+        void reuse(boost::asio::ip::tcp::socket socket_,
+                   std::shared_ptr<Io_Service_Manager> io_service_);
+
     protected:
+        // Called when the session is recycled. Override to clear per connection state.
+        virtual void reset() {}
+
+        // Read buffers are drawn from Buffer_Pool::get() and return to it once released.
+
         // Receive until a certain pattern is reached.
         void do_read(const std::string& s);
 
@@ -31,7 +50,11 @@ class Tcp_Base_Session : public std::enable_shared_from_this<Tcp_Base_Session>
                                   boost::system::error_code) = 0;
         virtual void do_write_work(boost::system::error_code, std::size_t length) = 0;
 
+        boost::asio::ip::tcp::socket& get_socket()
+            { return socket; }
+
     private:
+        std::shared_ptr<Io_Service_Manager> io_service; // null when owned by the server
         boost::asio::ip::tcp::socket socket;
 
 }; // Tcp_Base_Session
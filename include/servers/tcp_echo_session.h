@@ -12,6 +12,8 @@ class Tcp_Echo_Session : public Tcp_Base_Session
 {
     public:
         Tcp_Echo_Session(boost::asio::ip::tcp::socket socket);
+        Tcp_Echo_Session(boost::asio::ip::tcp::socket socket,
+                         std::shared_ptr<Io_Service_Manager> io_service);
         ~Tcp_Echo_Session() {}
 
         void start() override;
@@ -2,17 +2,26 @@
 #define CPP_NETWORKING_TCP_SERVER_H
 
 #include "io_service_manager.h"
+#include "io_service_pool.h"
+#include "socket_options.h"
 #include "servers/tcp_base_session.h"
+#include "servers/tcp_session_pool.h"
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "boost_config.h"
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
+#include <boost/thread/future.hpp>
 
 namespace net {
 
+class Tcp_Echo_Session; // forward declared
+
 class Tcp_Server
 {
 public:
@@ -23,33 +32,248 @@ public:
         Echo,
     };
 
-    Tcp_Server(Role_t, short port);
+    // How a server on an Io_Service_Pool listens.
+    enum class Listen_Mode_t
+    {
+        // One acceptor on one shard. Accepted sockets are placed on the shard picked by the
+        // pool's placement policy.
+        Single_Acceptor,
+
+        // One acceptor per shard, all bound to the port with SO_REUSEPORT, so the kernel
+        // spreads incoming connections across the shards. Each session stays on the shard
+        // that accepted it. Throws if the platform lacks SO_REUSEPORT.
+        Reuse_Port,
+    };
+
+    // How the accept loop takes connections off the listen backlog.
+    // Defaults are set by the constructor since the struct is a default argument below.
+    struct Accept_Options
+    {
+        Accept_Options() : listen_backlog(0), batch_accept(false), max_batch(64) {}
+
+        // Pending connections the listen backlog holds. 0 uses SOMAXCONN.
+        int listen_backlog;
+
+        // Accept the pending connections each time the listening socket becomes readable
+        // instead of one per accept operation, so a burst of connections is taken in one go.
+        bool batch_accept;
+
+        // Most connections a batch accepts before the loop waits again, so a flood of
+        // connections can't starve the other handlers of the acceptor's service. At least 1.
+        size_t max_batch;
+    };
+
+    /* Sessions:
+     *
+     * A Session_Factory starts the sessions a server runs and a Role_t converts to the factory
+     * of its built in session. Use pooled<Session_t>() to run any Tcp_Base_Session or
+     * Tcp_Static_Session subclass, such as a framed RPC handler or a proxy, constructible from
+     * a socket and the Io_Service_Manager owning it.
+     *
+     * The factory is type erased, so every accepted connection costs one call through a
+     * std::function to create and start its session. After that, the callbacks of a
+     * Tcp_Base_Session subclass are dispatched through its virtual functions and those of a
+     * Tcp_Static_Session subclass are called directly.
+     *
+     * A factory only describes the sessions. Every server makes its own Tcp_Session_Pool from
+     * it, so copies of a factory may be shared between servers and cached sessions are
+     * destroyed with the server whose services their sockets belong to.
+     */
+    // Holds a session of any kind and starts it. Only needs Session_t::start().
+    class Session_Handle
+    {
+        public:
+            template <typename Session_t>
+            Session_Handle(std::shared_ptr<Session_t> session_)
+              : session(session_),
+                start_fn([] (void* started) { static_cast<Session_t*>(started)->start(); })
+            {}
+
+            void start() const
+                { start_fn(session.get()); }
+
+        private:
+            std::shared_ptr<void> session;
+            void (*start_fn)(void*);
+    };
+
+    class Session_Factory
+    {
+        public:
+            using Create_Fn_t = std::function<Session_Handle(
+                    boost::asio::ip::tcp::socket, std::shared_ptr<Io_Service_Manager>)>;
+
+            static constexpr size_t default_max_cached_c = 1024;
+
+            // The built in session for role. Throws logic_error for an unknown role.
+            Session_Factory(Role_t role);
+
+            // Sessions made by create_fn, which may return a shared pointer to any session.
+            // Nothing is cached.
+            explicit Session_Factory(Create_Fn_t create_fn);
+
+            // Sessions of type Session_t recycled through a Tcp_Session_Pool caching at most
+            // max_cached of them.
+            template <typename Session_t>
+            static Session_Factory pooled(size_t max_cached = default_max_cached_c);
+
+        private:
+            friend class Tcp_Server;
+
+            using Start_Fn_t = std::function<void(
+                    boost::asio::ip::tcp::socket, std::shared_ptr<Io_Service_Manager>)>;
+
+            // The sessions of one server. start creates the session for an accepted socket and
+            // starts it, cached counts the sessions waiting to be reused and may be empty.
+            struct Sessions
+            {
+                Start_Fn_t start;
+                std::function<size_t()> cached;
+            };
+
+            using Make_Sessions_Fn_t = std::function<Sessions()>;
+
+            explicit Session_Factory(Make_Sessions_Fn_t make_sessions);
+
+            // Sessions of type Session_t recycled through a new Tcp_Session_Pool.
+            template <typename Session_t>
+            static Make_Sessions_Fn_t pooled_sessions(size_t max_cached);
+
+            // The sessions of role's built in session. Throws logic_error for an unknown role.
+            static Make_Sessions_Fn_t role_sessions(Role_t role);
+
+            Make_Sessions_Fn_t make_sessions;
+
+    }; // Session_Factory
+
+    // Every constructor takes the sessions to run, either a Role_t or a Session_Factory,
+    // Socket_Options to tune the listening socket and every accepted socket with, and
+    // Accept_Options for the accept loop.
+    Tcp_Server(Session_Factory sessions, short port,
+               const Socket_Options& options = Socket_Options(),
+               const Accept_Options& accept_options = Accept_Options());
+
+    // Run the acceptor and all sessions on a shared io_service. The service must be running
+    // and perpetual. Stopping the server closes the acceptor but leaves the service running.
+    Tcp_Server(Session_Factory sessions, short port,
+               std::shared_ptr<Io_Service_Manager> shared_io_service,
+               const Socket_Options& options = Socket_Options(),
+               const Accept_Options& accept_options = Accept_Options());
+
+    // Run the acceptor on one shard of the pool and place every accepted socket on the shard
+    // picked by the pool's placement policy.
+    Tcp_Server(Session_Factory sessions, short port,
+               std::shared_ptr<Io_Service_Pool> session_services,
+               const Socket_Options& options = Socket_Options(),
+               const Accept_Options& accept_options = Accept_Options());
+
+    // Run on the pool listening as mode says.
+    Tcp_Server(Session_Factory sessions, short port,
+               std::shared_ptr<Io_Service_Pool> session_services,
+               Listen_Mode_t mode, const Socket_Options& options = Socket_Options(),
+               const Accept_Options& accept_options = Accept_Options());
+
     ~Tcp_Server();
 
     // Stop the server. No more new connections are accepted. XXX do running sessions still continue?
+    // Blocks until the pending accept has been cancelled.
     void stop();
 
+    // Sessions of finished connections cached for reuse by new ones.
+    size_t cached_sessions();
+
+    // Times the accept loops woke up to accept connections. Without batch_accept every
+    // wakeup accepts one.
+    size_t accept_wakeups()
+        { return wakeups; }
+
 private:
-    // Async accept loop that creates a new session for every connected client.
-    void do_accept();
+    // An acceptor and the socket it is accepting into.
+    struct Listener
+    {
+        explicit Listener(boost::asio::io_service& acceptor_service);
+
+        boost::asio::ip::tcp::acceptor acceptor;
+        boost::asio::io_service::strand strand;
+        boost::asio::ip::tcp::socket socket;
 
-    // Creates and starts a new connection session of type server_role.
-    void new_connection(boost::asio::ip::tcp::socket);
+        // The shard owning socket. Null unless the server runs on an Io_Service_Pool.
+        std::shared_ptr<Io_Service_Manager> socket_service;
+
+        // The pool shard the acceptor runs on in Reuse_Port mode.
+        size_t shard;
+
+        // Set once the accept loop has exited after the acceptor is closed.
+        boost::promise<void> accept_stopped;
+    };
+
+    // Opens the acceptors and starts accepting. Buffer sizes are set before listening so
+    // accepted sockets inherit them from the handshake on.
+    void listen(short port);
+
+    // Async accept loop that creates a new session for every client connecting to listener.
+    // With batch_accept set it waits for the acceptor to become readable instead and then
+    // accepts until no connection is pending, or max_batch were accepted.
+    void do_accept(Listener& listener);
+    void accept_pending(Listener& listener);
+
+    // Readies listener's socket for the next accept, on the shard the session will run on.
+    void prepare_socket(Listener& listener);
+
+    // Tunes the socket listener just accepted and starts its session.
+    void start_session(Listener& listener);
+
+    // Creates and starts a new connection session with the session factory. socket_service
+    // is the shard owning the socket or null when it belongs to io_service.
+    void new_connection(boost::asio::ip::tcp::socket,
+                        std::shared_ptr<Io_Service_Manager> socket_service);
 
     // Server properties
-    const Role_t server_role;
+    const Socket_Options options;
+    const Accept_Options accept_options;
     bool running;
+    std::atomic<size_t> wakeups;
 
-    // Async objects
-    Io_Service_Manager io_service;
+    // Async objects. io_service runs the first acceptor.
+    std::shared_ptr<Io_Service_Manager> io_service;
+    const bool shared_io_service;
     std::shared_ptr<boost::thread> accept_thread;
 
+    // Shards accepted sockets are placed on. Null unless the server runs on an
+    // Io_Service_Pool.
+    std::shared_ptr<Io_Service_Pool> session_services;
+    const Listen_Mode_t listen_mode;
+
+    // Cached sessions keep sockets bound to the services above so they're declared after them.
+    const Session_Factory::Sessions sessions;
+
     // Networking objects
-    boost::asio::ip::tcp::acceptor acceptor;
-    boost::asio::ip::tcp::socket socket;
+    std::vector<std::unique_ptr<Listener>> listeners;
 
 }; // Tcp_Server
 
+template <typename Session_t>
+Tcp_Server::Session_Factory Tcp_Server::Session_Factory::pooled(size_t max_cached)
+{
+    return Session_Factory(pooled_sessions<Session_t>(max_cached));
+}
+
+template <typename Session_t>
+Tcp_Server::Session_Factory::Make_Sessions_Fn_t
+Tcp_Server::Session_Factory::pooled_sessions(size_t max_cached)
+{
+    return [max_cached] ()
+    {
+        auto pool = Tcp_Session_Pool<Session_t>::create(max_cached);
+        return Sessions {
+            [pool] (boost::asio::ip::tcp::socket socket,
+                    std::shared_ptr<Io_Service_Manager> io_service)
+                { pool->acquire(std::move(socket), io_service)->start(); },
+            [pool] () { return pool->cached(); }
+        };
+    };
+}
+
 } // net
 
 #endif
@@ -0,0 +1,121 @@
+#ifndef CPP_NETWORKING_TCP_SESSION_POOL_H
+#define CPP_NETWORKING_TCP_SESSION_POOL_H
+
+/* Tcp_Session_Pool
+ *
+ * Overview:
+ * Recycles server session objects so accepting a connection doesn't allocate a new session.
+ *
+ * Behavior:
+ * acquire() hands out a cached session rebound to the accepted socket, or constructs a new one
+ * when none is cached. Sessions are held by shared pointers like any other, and when the last
+ * one is released the session is recycled (its socket closed and its reset() hook run) and
+ * cached instead of destroyed. At most max_cached sessions are kept, the rest are destroyed.
+ *
+ * Sessions released after the pool is destroyed are destroyed as well.
+ *
+ * Design:
+ * Like Tcp_Pool, instances are created through a static create method and are always held by
+ * a shared pointer, so released sessions can tell whether their pool still exists. Session_t
+ * must derive from Tcp_Base_Session or Tcp_Static_Session<Session_t> and be constructible
+ * from a socket and the Io_Service_Manager owning it.
+ *
+ */
+
+#include "io_service_manager.h"
+#include "servers/tcp_base_session.h"
+#include "servers/tcp_static_session.h"
+
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+namespace net
+{
+
+template <typename Session_t>
+class Tcp_Session_Pool : public std::enable_shared_from_this<Tcp_Session_Pool<Session_t>>
+{
+    static_assert(std::is_base_of<Tcp_Base_Session, Session_t>::value or
+                  std::is_base_of<Tcp_Static_Session<Session_t>, Session_t>::value,
+                  "Tcp_Session_Pool: Session_t must derive from Tcp_Base_Session or "
+                  "Tcp_Static_Session<Session_t>");
+
+    public:
+        static std::shared_ptr<Tcp_Session_Pool> create(size_t max_cached)
+        {
+            return std::shared_ptr<Tcp_Session_Pool>( new Tcp_Session_Pool(max_cached) );
+        }
+
+        // io_service may be null, see Tcp_Static_Session.
+        std::shared_ptr<Session_t> acquire(boost::asio::ip::tcp::socket socket,
+                                           std::shared_ptr<Io_Service_Manager> io_service)
+        {
+            std::unique_ptr<Session_t> session;
+            {
+                std::lock_guard<std::mutex> lck(lock);
+                if (!free_sessions.empty())
+                {
+                    session = std::move(free_sessions.back());
+                    free_sessions.pop_back();
+                }
+            }
+
+            if (session)
+            {
+                session->reuse(std::move(socket), io_service);
+            }
+            else
+            {
+                session.reset(new Session_t(std::move(socket), io_service));
+            }
+
+            std::weak_ptr<Tcp_Session_Pool> wp(this->shared_from_this());
+            return std::shared_ptr<Session_t>(session.release(), [wp] (Session_t* released)
+                {
+                    std::unique_ptr<Session_t> owned(released);
+                    if (auto sp = wp.lock())
+                    {
+                        sp->release(std::move(owned));
+                    }
+                }
+            );
+        }
+
+        // Number of sessions waiting to be reused.
+        size_t cached()
+        {
+            std::lock_guard<std::mutex> lck(lock);
+            return free_sessions.size();
+        }
+
+    private:
+        explicit Tcp_Session_Pool(size_t max_cached_)
+            : max_cached(max_cached_)
+        {}
+
+        void release(std::unique_ptr<Session_t> session)
+        {
+            // Recycled outside the lock since closing the socket is a system call.
+            session->recycle();
+
+            std::lock_guard<std::mutex> lck(lock);
+            if (free_sessions.size() < max_cached)
+            {
+                free_sessions.push_back(std::move(session));
+            }
+        }
+
+        const size_t max_cached;
+        std::vector<std::unique_ptr<Session_t>> free_sessions;
+        std::mutex lock;
+
+}; // Tcp_Session_Pool
+
+} // net
+
+#endif
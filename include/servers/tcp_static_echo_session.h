@@ -0,0 +1,33 @@
+#ifndef CPP_NETWORKING_TCP_STATIC_ECHO_SESSION_H
+#define CPP_NETWORKING_TCP_STATIC_ECHO_SESSION_H
+
+#include "servers/tcp_static_session.h"
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+namespace net {
+
+// Tcp_Echo_Session with its callbacks resolved at compile time.
+class Tcp_Static_Echo_Session final : public Tcp_Static_Session<Tcp_Static_Echo_Session>
+{
+    public:
+        Tcp_Static_Echo_Session(boost::asio::ip::tcp::socket socket,
+                                std::shared_ptr<Io_Service_Manager> io_service);
+        ~Tcp_Static_Echo_Session() {}
+
+        void start();
+
+    private:
+        friend class Tcp_Static_Session<Tcp_Static_Echo_Session>;
+
+        void do_read_work(std::shared_ptr<boost::asio::streambuf>,
+                          boost::system::error_code);
+
+        void do_write_work(boost::system::error_code, std::size_t length);
+
+}; // Tcp_Static_Echo_Session
+
+} // net
+
+#endif
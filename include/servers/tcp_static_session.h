@@ -0,0 +1,137 @@
+#ifndef CPP_NETWORKING_TCP_STATIC_SESSION_H
+#define CPP_NETWORKING_TCP_STATIC_SESSION_H
+
+/* Tcp_Static_Session
+ *
+ * Overview:
+ * A server session whose callbacks are resolved at compile time.
+ *
+ * Behavior:
+ * Derive Session_t from Tcp_Static_Session<Session_t> and implement start, do_read_work and
+ * do_write_work, and optionally reset, like for Tcp_Base_Session but without virtual. The
+ * reads and writes call them on Session_t directly, so the per message path of the session
+ * can be inlined into the completion handlers. Make Tcp_Static_Session<Session_t> a friend of
+ * Session_t if the callbacks aren't public, and declare Session_t final since it is destroyed
+ * as a Session_t.
+ *
+ * Sessions run on Tcp_Server through Session_Factory::pooled<Session_t>() like any other.
+ *
+ * Design:
+ * Implemented with the curiously recurring template pattern and no virtual functions, so it
+ * is not a Tcp_Base_Session. Tcp_Server and Tcp_Session_Pool run either kind.
+ *
+ */
+
+#include "buffer_pool.h"
+#include "io_service_manager.h"
+#include "logger.h"
+
+#include <memory>
+#include <string>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+namespace net {
+
+template <typename Session_t>
+class Tcp_Static_Session : public std::enable_shared_from_this<Session_t>
+{
+    public:
+        Tcp_Static_Session(boost::asio::ip::tcp::socket socket_)
+            : socket(std::move(socket_))
+        {}
+
+        // Keeps the io_service owning socket_ alive for the lifetime of the session. Used
+        // when sockets are placed on Io_Service_Pool shards.
+        Tcp_Static_Session(boost::asio::ip::tcp::socket socket_,
+                           std::shared_ptr<Io_Service_Manager> io_service_)
+            : io_service(io_service_),
+              socket(std::move(socket_))
+        {}
+
+        // Tcp_Session_Pool hooks. recycle() closes the socket, releases the io_service and
+        // calls reset() so the session can be cached. reuse() hands a recycled session the
+        // next accepted socket, after which it is started like a new one.
+        void recycle()
+        {
+            boost::system::error_code ec;
+            socket.close(ec);
+            io_service.reset();
+            session().reset();
+        }
+
+        void reuse(boost::asio::ip::tcp::socket socket_,
+                   std::shared_ptr<Io_Service_Manager> io_service_)
+        {
+            io_service = io_service_;
+            socket = std::move(socket_);
+        }
+
+    protected:
+        // Never destroyed through this class.
+        ~Tcp_Static_Session() {}
+
+        // Called when the session is recycled. Hide it to clear per connection state.
+        void reset() {}
+
+        // Read buffers are drawn from Buffer_Pool::get() and return to it once released.
+
+        // Receive until a certain pattern is reached.
+        void do_read(const std::string& pattern)
+        {
+            auto self(this->shared_from_this());
+            auto res = Buffer_Pool::get().acquire();
+            boost::asio::async_read_until(socket, *res, pattern,
+                [this, self, res] (const boost::system::error_code& ec, size_t length)
+                {
+                    Logger::get()->debug(" | read {} bytes", length);
+                    session().do_read_work(res, ec);
+                }
+            );
+        }
+
+        // Read until a certain size is reached.
+        void do_read(size_t len)
+        {
+            auto self(this->shared_from_this());
+            auto res = Buffer_Pool::get().acquire(len);
+            boost::asio::async_read(socket, *res, boost::asio::transfer_at_least(len),
+                [this, self, res] (const boost::system::error_code& ec, size_t length)
+                {
+                    Logger::get()->debug(" | read {} bytes", length);
+                    session().do_read_work(res, ec);
+                }
+            );
+        }
+
+        void do_write(std::shared_ptr<boost::asio::streambuf> buf)
+        {
+            auto self(this->shared_from_this());
+
+            // buf is captured to keep the data alive until the write completes.
+            boost::asio::async_write(socket, *buf,
+                [this, self, buf] (boost::system::error_code ec, std::size_t length)
+                {
+                    // XXX Check ec for client disconnection
+                    Logger::get()->debug(" | wrote {} bytes", length);
+                    session().do_write_work(ec, length);
+                }
+            );
+        }
+
+        boost::asio::ip::tcp::socket& get_socket()
+            { return socket; }
+
+    private:
+        Session_t& session()
+            { return static_cast<Session_t&>(*this); }
+
+        std::shared_ptr<Io_Service_Manager> io_service; // null when owned by the server
+        boost::asio::ip::tcp::socket socket;
+
+}; // Tcp_Static_Session
+
+} // net
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef CPP_NETWORKING_SOCKET_OPTIONS_H
+#define CPP_NETWORKING_SOCKET_OPTIONS_H
+
+/* Socket_Options
+ *
+ * Overview:
+ * Socket level tuning applied by Tcp when connecting and by Tcp_Server when listening and
+ * accepting.
+ *
+ * Behavior:
+ * A default constructed Socket_Options changes nothing, every option left at its default keeps
+ * the system's setting. Sizes are in bytes and 0 leaves them alone.
+ *
+ * Buffer sizes are applied before connecting, or to the listening socket before it listens, so
+ * the TCP window scale negotiated on the handshake can make use of them. Options the platform
+ * doesn't support are skipped. A failure to apply an option is logged and the connection is
+ * used anyway with the system's setting.
+ *
+ * SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN.
+ *
+ */
+
+#include <cstddef>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+namespace net
+{
+
+// A SettableSocketOption for int valued options boost::asio has no type for, ex.
+// Int_Socket_Option<SOL_SOCKET, SO_BUSY_POLL>. Booleans are ints to setsockopt too.
+template <int Level, int Name>
+class Int_Socket_Option
+{
+    public:
+        explicit Int_Socket_Option(int value_) : value(value_) {}
+
+        template <typename Protocol>
+        int level(const Protocol&) const
+            { return Level; }
+
+        template <typename Protocol>
+        int name(const Protocol&) const
+            { return Name; }
+
+        template <typename Protocol>
+        const int* data(const Protocol&) const
+            { return &value; }
+
+        template <typename Protocol>
+        std::size_t size(const Protocol&) const
+            { return sizeof(value); }
+
+    private:
+        int value;
+};
+
+struct Socket_Options
+{
+    // TCP_NODELAY. Send small writes right away instead of waiting to coalesce them (Nagle).
+    bool no_delay = false;
+
+    // TCP_QUICKACK. ACK received data right away instead of delaying the ACK. Linux only.
+    // The flag isn't sticky: the kernel leaves quick ACK mode on its own and goes back to
+    // delaying ACKs, so Tcp re-applies it after every receive. That costs a setsockopt per
+    // receive, which connections leaving quick_ack unset don't pay.
+    bool quick_ack = false;
+
+    // SO_KEEPALIVE. Probe idle connections so a vanished peer is eventually detected.
+    bool keep_alive = false;
+
+    // SO_RCVBUF and SO_SNDBUF.
+    int receive_buffer_size = 0;
+    int send_buffer_size = 0;
+
+    // SO_BUSY_POLL. Microseconds to busy poll the device queue on a blocking receive, 0 leaves
+    // it off. Linux only.
+    int busy_poll_usec = 0;
+
+    // Applies the buffer sizes. Call this once the socket is open and before it connects
+    // or listens.
+    void apply_before_connect(boost::asio::ip::tcp::socket& socket,
+                              boost::system::error_code& ec) const;
+    void apply_before_connect(boost::asio::ip::tcp::acceptor& acceptor,
+                              boost::system::error_code& ec) const;
+
+    // Applies everything else to a connected socket.
+    void apply(boost::asio::ip::tcp::socket& socket, boost::system::error_code& ec) const;
+
+    // Applies TCP_QUICKACK again, if set. Does nothing where TCP_QUICKACK isn't supported.
+    void apply_quick_ack(boost::asio::ip::tcp::socket& socket,
+                         boost::system::error_code& ec) const;
+};
+
+} // net
+
+#endif
@@ -1,14 +1,23 @@
 #ifndef CPP_NETWORKING_TCP_H
 #define CPP_NETWORKING_TCP_H
 
+#include "buffer_pool.h"
 #include "io_service_manager.h"
 #include "logger.h"
+#include "socket_options.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "boost_config.h"
 #include <boost/asio.hpp>
+#include <boost/asio/spawn.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/future.hpp>
 
@@ -17,17 +26,65 @@ namespace net {
 class Tcp
 {
     public:
+        class Receive_View; // forward declared
+
         using Send_Return_t = boost::future<size_t>;
         using Receive_Return_t = boost::future<std::shared_ptr<std::string>>;
+        using Receive_View_Return_t = boost::future<std::shared_ptr<const Receive_View>>;
+        using Connect_Return_t = boost::future<std::unique_ptr<Tcp>>;
+        using Send_Handler_t = std::function<void(const boost::system::error_code&, size_t)>;
+        using Receive_Handler_t = std::function<void(const boost::system::error_code&,
+                                                     std::shared_ptr<std::string>)>;
+        using Connect_Callback_t = std::function<void(const boost::system::error_code&,
+                                                      std::unique_ptr<Tcp>)>;
 
+        // Connects using a private perpetual Io_Service_Manager with its own worker thread.
+        // Every constructor takes Socket_Options to tune the socket with.
         // XXX blocking
-        explicit Tcp(const std::string& host, const std::string& service);
+        explicit Tcp(const std::string& host, const std::string& service,
+                     const Socket_Options& options = Socket_Options());
 
+        // Connects using a shared Io_Service_Manager. Any number of Tcp objects can run on
+        // the same service so connection count is independent of thread count. The service
+        // must be running and perpetual; closing this connection does not stop it.
+        // XXX blocking
+        Tcp(const std::string& host, const std::string& service,
+            std::shared_ptr<Io_Service_Manager> shared_io_service,
+            const Socket_Options& options = Socket_Options());
+
+        /* Asynchronous Connecting:
+         *
+         * Resolves and connects without blocking the caller. The connection runs on the shared
+         * service which must be running and perpetual.
+         *
+         * Resolved endpoints are raced Happy Eyeballs style (RFC 8305): address families are
+         * interleaved and a new attempt starts whenever the previous one fails or has not
+         * finished within a short delay. The first attempt to connect wins and the rest are
+         * cancelled.
+         *
+         * The callback is executed by a worker of the shared service and receives a null
+         * connection on error. The future variant throws the error as a system_error.
+         */
+        static Connect_Return_t async_create(const std::string& host, const std::string& service,
+                                             std::shared_ptr<Io_Service_Manager> shared_io_service,
+                                             const Socket_Options& options = Socket_Options());
+        static void async_create(const std::string& host, const std::string& service,
+                                 std::shared_ptr<Io_Service_Manager> shared_io_service,
+                                 Connect_Callback_t callback,
+                                 const Socket_Options& options = Socket_Options());
+
+        // When running on a shared service this waits for outstanding operations to finish,
+        // so it must not be called from one of that service's handlers.
         // XXX blocking
         ~Tcp();
 
         bool is_open();
 
+        // Non-blocking probe for an idle connection whose peer closed or reset it. Peeks at
+        // the socket without consuming anything, so it's only meaningful while no receive
+        // is outstanding. Unread data counts as alive.
+        bool is_alive();
+
         void close();
 
         /* Sending Data:
@@ -36,6 +93,10 @@ class Tcp
          *
          * Make sure data being sent will continue to exist until the operation finishes.
          *
+         * Sends are written one at a time in the order they were made, and so are receives. The
+         * two directions are serialized separately so a send and a receive can progress at the
+         * same time on different io_service workers.
+         *
          * TODO: test error codes
          * TODO: send fns that throw errors
          */
@@ -44,6 +105,19 @@ class Tcp
         Send_Return_t send(const std::string&, boost::system::error_code&);
         Send_Return_t send(const int, boost::system::error_code&);
 
+        /* Write Coalescing:
+         *
+         * Off by default. While enabled sends are gathered on the send strand instead of being written
+         * one by one. Gathered sends go out together in a single scatter / gather write once
+         * flush_bytes are pending or flush_delay has passed since the first of them was queued.
+         * Sends queued while a write is in flight are written as soon as it finishes.
+         *
+         * Each future still receives the size of its own send. Disabling flushes anything pending.
+         */
+        void enable_write_coalescing(size_t flush_bytes,
+                                     boost::posix_time::time_duration flush_delay);
+        void disable_write_coalescing();
+
         /* Receiving Data:
          *
          * All receive operations are asynchronous and immediately return a future containing data.
@@ -59,9 +133,58 @@ class Tcp
         Receive_Return_t receive(size_t size, boost::system::error_code&);
         Receive_Return_t receive(std::string pattern, boost::system::error_code&);
 
+        /* Sending and Receiving with Handlers:
+         *
+         * Same as the operations above but the result is passed to a handler instead of a future,
+         * skipping the promise and its shared state. Handlers are executed by an io_service
+         * worker and must not block it.
+         *
+         * Errors are passed to the handler. On a disconnection the connection is closed and the
+         * handler still receives the bytes sent or the data received before it. Other receive
+         * errors pass a null string.
+         */
+        void send(const boost::asio::const_buffer&, Send_Handler_t);
+        void send(const std::vector<boost::asio::const_buffer>&, Send_Handler_t);
+        void send(const std::string&, Send_Handler_t);
+
+        void receive(Receive_Handler_t);
+        void receive(size_t size, Receive_Handler_t);
+        void receive(std::string pattern, Receive_Handler_t);
+
+        /* Sending and Receiving in Coroutines:
+         *
+         * Same as the operations above but suspend the calling coroutine (started with
+         * boost::asio::spawn) until the operation finishes, so protocol code can be written
+         * sequentially. The coroutine is resumed on its own strand.
+         *
+         * Errors are thrown as system_error unless an error_code is bound with yield[ec].
+         * A disconnection is reported as an error as well.
+         */
+        size_t send(const boost::asio::const_buffer&, boost::asio::yield_context);
+        size_t send(const std::vector<boost::asio::const_buffer>&, boost::asio::yield_context);
+        size_t send(const std::string&, boost::asio::yield_context);
+
+        std::shared_ptr<std::string> receive(boost::asio::yield_context);
+        std::shared_ptr<std::string> receive(size_t size, boost::asio::yield_context);
+        std::shared_ptr<std::string> receive(std::string pattern, boost::asio::yield_context);
+
+        /* Receiving Views:
+         *
+         * Same as receiving a length of data or until a pattern but without copying the data
+         * out of the receive buffer. The returned view points directly into the buffer and the
+         * data is consumed once the last reference to the view is released.
+         *
+         * While a view is held later receive operations are queued and only start once it is
+         * released. A view may outlive its connection, it then keeps the viewed data alive on
+         * its own and the receives queued behind it fail.
+         */
+        Receive_View_Return_t receive_view(size_t size, boost::system::error_code&);
+        Receive_View_Return_t receive_view(std::string pattern, boost::system::error_code&);
+
     private:
         using Send_Prom_t = std::shared_ptr<boost::promise<size_t>>;
         using Receive_Prom_t = std::shared_ptr<boost::promise<std::shared_ptr<std::string>>>;
+        using Receive_View_Prom_t = std::shared_ptr<boost::promise<std::shared_ptr<const Receive_View>>>;
         using Send_Callback_t = std::function<void(const boost::system::error_code&, size_t)>;
         using Receive_Callback_t = std::function<void(const boost::system::error_code&, size_t)>;
 
@@ -73,21 +196,92 @@ class Tcp
             Bad,
         };
 
+        // Races connection attempts for async_create(). Defined in tcp.cpp.
+        class Connector;
+
+        // A send waiting to be coalesced with others.
+        struct Pending_Send
+        {
+            std::vector<boost::asio::const_buffer> data;
+            size_t size;
+            Send_Callback_t on_sent;
+        };
+
+        // Creates an unconnected client on a shared service for a Connector to open.
+        Tcp(std::shared_ptr<Io_Service_Manager> shared_io_service, const Socket_Options& options);
+
         // XXX blocking
         void connect(const std::string& host, const std::string& service);
 
-        // Post a send / receive function to socket_rw_strand. The passed in function must
+        // Applies options to the connected socket, logging any that fail.
+        void apply_socket_options();
+
+        // Post a send / receive function to send_strand / recv_strand. The passed in function must
         // accept a Send/Receive_Callback_t. The callback is used to return socket data
         // back to the future given to the caller.
-        Send_Return_t post_send_to_strand(std::function<void(Send_Callback_t)> send_fn);
+        Send_Return_t post_send_to_strand(std::vector<boost::asio::const_buffer> data);
         Receive_Return_t post_recv_to_strand(std::function<void(Receive_Callback_t)> recv_fn);
-        
+
+        // Same as above but on_sent / handler is called with the result instead of a promise.
+        void post_send_to_strand(std::vector<boost::asio::const_buffer> data,
+                                 Send_Callback_t on_sent);
+        void post_recv_to_strand(std::function<void(Receive_Callback_t)> recv_fn,
+                                 Receive_Handler_t handler);
+        Receive_View_Return_t post_recv_view_to_strand(std::function<void(Receive_Callback_t)> recv_fn);
+
+        // Reads until receive_data holds size bytes and passes size to callback. Only call this
+        // from recv_strand.
+        void read_size(size_t size, Receive_Callback_t callback);
+
+        // Reads until the connection fails or is closed and passes everything in receive_data
+        // to callback. Only call this from recv_strand.
+        void read_all(Receive_Callback_t callback);
+
+        // Starts a receive operation unless another is in flight or a view is held, in which
+        // case it is queued until they finish. Only call this from recv_strand.
+        void start_or_defer_receive(std::function<void()> start_fn);
+
+        // Called after a receive's result is handled. Starts the next queued receive unless the
+        // result was a view that is still held.
+        void finish_receive();
+
+        // Writes data right away or queues it for coalescing. Only call this from send_strand.
+        void start_send(const std::vector<boost::asio::const_buffer>& data, Send_Callback_t on_sent);
+
+        // Writes every pending send at once unless a write is already in flight. Only call this
+        // from send_strand.
+        void flush_sends();
+        void handle_flush_delay(const boost::system::error_code& ec);
+        void handle_coalesced_send(const boost::system::error_code& ec, size_t length,
+                                   std::shared_ptr<std::vector<Pending_Send>> batch);
+
         void handle_send(const boost::system::error_code& ec, size_t length, Send_Prom_t prom);
+        void handle_send(const boost::system::error_code& ec, size_t length,
+                         const Send_Handler_t& handler);
         void handle_receive(const boost::system::error_code& ec, size_t length, Receive_Prom_t prom);
+        void handle_receive(const boost::system::error_code& ec, size_t length,
+                            const Receive_Handler_t& handler);
+        void handle_receive_view(const boost::system::error_code& ec, size_t length,
+                                 Receive_View_Prom_t prom);
+
+        // Consumes a released view's data and starts the receives queued behind it.
+        void release_view(size_t length);
+
+        // Called on destruction. Views still held stop releasing into the connection and keep
+        // the receive buffer, the receives queued behind them start on a fresh one.
+        void detach_views();
+
         void handle_disconnect();
 
         bool is_disconnect_error(const boost::system::error_code& ec);
 
+        // Track send / receive operations whose handlers still reference this object.
+        // Only used when running on a shared service, since a private service is stopped
+        // (dropping its handlers) before destruction.
+        void begin_operation();
+        void end_operation();
+        void wait_for_operations();
+
         // Reads length bytes from receive_data into a string. Only call this in an async_read
         // callback when you can guaruntee that length data is in the buffer.
         std::shared_ptr<std::string> consume_receive_data(size_t length);
@@ -105,15 +299,85 @@ class Tcp
          * returned still exists in the buffer. That data is consumed first then more data is read
          * in from the socket.
          *
+         * The buffer is drawn from Buffer_Pool::get() and goes back to it with the connection.
+         *
          */
-        boost::asio::streambuf receive_data;
-        Io_Service_Manager io_service;
+        Buffer_Pool::Buffer_t receive_data;
+        std::shared_ptr<Io_Service_Manager> io_service;
+        const bool owns_service; // True when io_service is private to this connection.
         boost::asio::ip::tcp::socket socket;
-        boost::asio::io_service::strand socket_rw_strand;
-        Status_t connection_status;
+        const Socket_Options options;
+        boost::asio::io_service::strand send_strand;
+        boost::asio::io_service::strand recv_strand;
+
+        // Atomic since a disconnect on either strand closes the connection, see close().
+        std::atomic<Status_t> connection_status;
+
+        size_t pending_operations;
+        std::mutex pending_operations_lock;
+        std::condition_variable operations_done_cv;
+
+        // Lets views reach the connection while it exists. tcp is null once it is destroyed.
+        struct View_Owner
+        {
+            explicit View_Owner(Tcp* tcp_) : tcp(tcp_) {}
+
+            std::mutex lock;
+            Tcp* tcp;
+        };
+        std::shared_ptr<View_Owner> view_owner;
+
+        // Set while a Receive_View points into receive_data.
+        bool view_held;
+        bool receive_in_flight;
+        std::deque<std::function<void()>> deferred_receives;
+        std::mutex receive_lock;
+
+        // Write coalescing state. Only touched from send_strand. flush_in_flight is also set
+        // while an uncoalesced send is written.
+        bool coalescing;
+        size_t flush_bytes;
+        boost::posix_time::time_duration flush_delay;
+        boost::asio::deadline_timer flush_timer;
+        std::vector<Pending_Send> pending_sends;
+        size_t pending_send_bytes;
+        bool flush_in_flight;
 
 }; // Tcp
 
+class Tcp::Receive_View
+{
+    public:
+        // Consumes the viewed data from the connection's receive buffer.
+        ~Receive_View();
+
+        // Disallow copy construction and assignment.
+        Receive_View(const Receive_View&) = delete;
+        Receive_View& operator=(const Receive_View&) = delete;
+
+        const boost::asio::const_buffer& data() const
+            { return view; }
+
+        size_t size() const
+            { return boost::asio::buffer_size(view); }
+
+        std::string str() const
+            { return std::string(boost::asio::buffer_cast<const char*>(view), size()); }
+
+    private:
+        friend class Tcp;
+
+        Receive_View(std::shared_ptr<View_Owner> owner_, Buffer_Pool::Buffer_t data_,
+                     boost::asio::const_buffer view_)
+            : owner(owner_), data_buffer(data_), view(view_)
+        {}
+
+        std::shared_ptr<View_Owner> owner;
+        Buffer_Pool::Buffer_t data_buffer; // keeps view valid if the connection goes first
+        boost::asio::const_buffer view;
+
+}; // Tcp::Receive_View
+
 } // net
 
 #endif
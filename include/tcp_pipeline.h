@@ -0,0 +1,106 @@
+#ifndef CPP_NETWORKING_TCP_PIPELINE_H
+#define CPP_NETWORKING_TCP_PIPELINE_H
+
+/* Tcp_Pipeline
+ *
+ * Overview:
+ * Pipelines request / response exchanges over a single Tcp connection.
+ *
+ * Behavior:
+ * request() sends the request and immediately returns a future for its response without
+ * waiting on earlier requests, so any number of them can be outstanding on the connection.
+ * The peer must answer requests in the order it received them, each response ending in a
+ * delimiter or having a known size. Responses are matched back to their futures in the same
+ * order.
+ *
+ * A request whose send or receive fails throws the error as a system_error from its future.
+ * A disconnection fails every request still waiting on a response, even one that received
+ * part of it.
+ *
+ * Design:
+ * Tcp already writes sends one at a time in the order they were made, and receives likewise.
+ * The pipeline only has to issue each request's send and receive together, under a lock, so
+ * that concurrent callers can't interleave them. Like Tcp, the caller must keep request data
+ * alive until its future is ready.
+ *
+ */
+
+#include "io_service_manager.h"
+#include "tcp.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+#include <boost/thread/future.hpp>
+
+namespace net
+{
+
+class Tcp_Pipeline
+{
+    public:
+        using Response_Return_t = Tcp::Receive_Return_t;
+
+        // Takes over a connected client, such as one from Tcp::async_create().
+        explicit Tcp_Pipeline(std::unique_ptr<Tcp> client);
+
+        // XXX blocking
+        Tcp_Pipeline(const std::string& host, const std::string& service);
+
+        // XXX blocking
+        Tcp_Pipeline(const std::string& host, const std::string& service,
+                     std::shared_ptr<Io_Service_Manager> shared_io_service);
+
+        // Disallow copy construction and assignment.
+        Tcp_Pipeline(const Tcp_Pipeline&) = delete;
+        Tcp_Pipeline& operator=(const Tcp_Pipeline&) = delete;
+
+        // The response runs up to and including delimiter.
+        Response_Return_t request(const boost::asio::const_buffer& data, std::string delimiter);
+        Response_Return_t request(const std::string& data, std::string delimiter);
+
+        // The response is response_size bytes long.
+        Response_Return_t request(const boost::asio::const_buffer& data, size_t response_size);
+        Response_Return_t request(const std::string& data, size_t response_size);
+
+        // Requests sent that are still waiting on their response.
+        size_t outstanding() const
+            { return outstanding_requests; }
+
+        bool is_open()
+            { return client->is_open(); }
+
+        void close()
+            { client->close(); }
+
+    private:
+        // Settled by whichever of a request's send and receive finishes it first.
+        struct Pending_Request
+        {
+            boost::promise<std::shared_ptr<std::string>> prom;
+            std::atomic<bool> settled;
+        };
+
+        // Sends data and calls receive_fn with the handler for its response, atomically with
+        // respect to other requests.
+        Response_Return_t pipeline(const boost::asio::const_buffer& data,
+                                   std::function<void(Tcp::Receive_Handler_t)> receive_fn);
+
+        void fail(Pending_Request& request, const boost::system::error_code& ec);
+
+        std::atomic<size_t> outstanding_requests;
+        std::mutex order_lock;
+
+        // Declared last so its outstanding operations finish before the members they use are
+        // destroyed.
+        std::unique_ptr<Tcp> client;
+};
+
+} // net
+
+#endif
@@ -2,16 +2,25 @@
 #define CPP_NETWORKING_TCP_POOL_H
 
 #include "io_service_manager.h"
+#include "socket_options.h"
 #include "tcp.h"
+#include "timer_wheel.h"
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
 #include <memory>
-#include <queue>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "boost_config.h"
 #include <boost/asio/deadline_timer.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/future.hpp>
 
 /* Tcp_Pool and Tcp_Guard
  *
@@ -20,7 +29,10 @@
  *
  * Behavior:
  * Every connection in the pool has a timer which will disconnect the connection once
- * the time is up. Call the get method to acquire a connection (it may already be in
+ * the time is up. The timers run on a Timer_Wheel shared with every pool on the same
+ * io_service and timeout, so returning a connection doesn't create a deadline_timer, and
+ * may expire up to 1/16th of the timeout late.
+ * Call the get method to acquire a connection (it may already be in
  * the pool or newly created). All connections taken out of the pool are protected by
  * a guard. Guards safely return the protected connection to the pool upon destruction.
  * A user of this class only needs to call get() and start using the connection.
@@ -33,49 +45,262 @@
  * protected connection has no pool to return to and will get destroyed along with the
  * guard.
  *
+ * Idle connections are kept in shards, one per hardware thread, each with its own lock.
+ * Threads return connections to, and take them from, the shard picked by their thread id
+ * and only look at other shards when theirs is empty, so concurrent get() and guard
+ * destruction on different threads rarely touch the same lock.
+ *
+ * Reuse:
+ * The reuse policy orders each shard, not the pool as a whole. By default get() hands out
+ * the connection that has been idle longest in the calling thread's shard (FIFO), which keeps
+ * the connections cycling through that shard. Reuse_Policy_t::Lifo hands out the shard's most
+ * recently returned connection instead. The connections in use then shrink to the actual
+ * concurrency and the rest age out through their idle timers. A connection in another shard
+ * may have been idle longer, it is only taken once the calling thread's shard is empty.
+ *
+ * Liveness:
+ * Cached connections are probed with Tcp::is_alive() as they are taken. Connections the peer
+ * closed while they sat idle are discarded and the next one is tried, or a new one opened.
+ * set_sweep_interval() also probes every cached connection periodically in the background.
+ *
+ * Warming:
+ * set_min_idle() asks the pool to keep at least that many connections cached. Missing
+ * connections are opened asynchronously right away, and again whenever get() takes one, so
+ * callers rarely pay for resolving and connecting. Idle connections at the floor don't expire;
+ * their timers are restarted instead. Warming connections count against max_connections.
+ *
+ * Bounding:
+ * set_max_connections() caps the number of open connections, idle or in use, the pool
+ * will hold to its host. Once the cap is reached callers wait in FIFO order for a guard to
+ * return its connection, or to close it which frees a slot for a new connection. Waiting
+ * async_get() calls may be given an acquire timeout after which they fail with timed_out.
+ * The default of 0 leaves the pool unbounded.
+ *
+ * Pools can be created on a shared Io_Service_Manager. In that case the deadline timers
+ * and every connection in the pool run on the shared service instead of each getting a
+ * private worker thread.
+ *
  */
 
 namespace net
 {
 
+class Tcp_Pool_Manager; // forward declared
+
 class Tcp_Pool : public std::enable_shared_from_this<Tcp_Pool>
 {
     public:
         class Tcp_Guard; // forward declared
 
-        using Timed_Tcp_Connection_t = std::pair<std::unique_ptr<net::Tcp>,
-                                                 std::shared_ptr<boost::asio::deadline_timer>>;
+        using Get_Handler_t = std::function<void(const boost::system::error_code&, Tcp_Guard)>;
+
+        // Order cached connections are handed out in.
+        enum class Reuse_Policy_t
+        {
+            Fifo, // oldest idle connection of the shard first
+            Lifo  // most recently returned connection of the shard first
+        };
+
+        // Every connection the pool opens is tuned with options.
+        static std::shared_ptr<Tcp_Pool> create(
+                const std::string& host,
+                const std::string& service,
+                boost::posix_time::time_duration duration,
+                const Socket_Options& options = Socket_Options());
 
+        // Create a pool whose timers and connections run on a shared io_service.
         static std::shared_ptr<Tcp_Pool> create(
                 const std::string& host,
                 const std::string& service,
-                boost::posix_time::time_duration duration);
+                boost::posix_time::time_duration duration,
+                std::shared_ptr<Io_Service_Manager> shared_io_service,
+                const Socket_Options& options = Socket_Options());
 
         ~Tcp_Pool();
 
+        // Blocks while the pool is at its cap, so it must not be called from one of the
+        // pool's io_service handlers.
+        // XXX blocking
         Tcp_Guard get();
 
+        // Same as get() but never blocks on a pool miss. New connections are resolved and
+        // connected asynchronously on the pool's io_service (private or shared) and the
+        // future throws a system_error if connecting fails.
+        //
+        // When the pool is at its cap the call waits for a connection instead. A waiting
+        // caller is completed by the thread returning or closing a guard. Given an
+        // acquire_timeout it fails with boost::asio::error::timed_out once that passes.
+        //
+        // The handler variants receive an empty guard on error.
+        boost::future<Tcp_Guard> async_get();
+        boost::future<Tcp_Guard> async_get(boost::posix_time::time_duration acquire_timeout);
+        void async_get(Get_Handler_t handler);
+        void async_get(boost::posix_time::time_duration acquire_timeout, Get_Handler_t handler);
+
+        // 0 means unbounded. Lowering the cap doesn't close connections already open.
+        void set_max_connections(size_t max_connections);
+
+        // Fifo unless set.
+        void set_reuse_policy(Reuse_Policy_t reuse_policy);
+
+        // 0 unless set. Starts opening connections up to the floor.
+        void set_min_idle(size_t min_idle);
+
+        // Discards dead cached connections every interval. Disabled unless set to a positive
+        // interval. Sweeps run on the idle timers so they are at most 1/16th of the timeout
+        // late.
+        void set_sweep_interval(boost::posix_time::time_duration interval);
+
+        // Connections cached in the pool.
+        size_t idle_count();
+
+        // Connections opened by the pool that are cached or held by a guard.
+        size_t open_count();
+
     private:
+        friend class Tcp_Pool_Manager;
+
+        // A pool with a manager takes connection slots from the manager's budget too.
         Tcp_Pool(const std::string& host,
                  const std::string& service,
-                 boost::posix_time::time_duration duration);
+                 boost::posix_time::time_duration duration,
+                 std::shared_ptr<Io_Service_Manager> io_service_manager,
+                 std::weak_ptr<Tcp_Pool_Manager> manager,
+                 const Socket_Options& options);
+
+        // A cached connection and the timer that expires it.
+        struct Idle_Connection
+        {
+            std::unique_ptr<net::Tcp> tcp_client;
+            Timer_Wheel::Timer_Id_t idle_timer;
+            boost::posix_time::ptime idle_since;
+        };
+
+        // A caller of async_get() waiting for the pool to drop below its cap.
+        struct Waiter
+        {
+            uint64_t id;
+            Get_Handler_t handler;
+            std::shared_ptr<boost::asio::deadline_timer> acquire_timer; // null without a timeout
+        };
+
+        // Creates a new connection on the private or shared io_service.
+        std::unique_ptr<net::Tcp> new_connection();
+
+        // Connects asynchronously for a caller that already holds a connection slot.
+        void async_new_connection(Get_Handler_t handler);
 
+        // Idle connections cached by the threads mapped onto this shard. The front
+        // connection is the oldest and the back connection is the youngest.
+        struct Idle_Shard
+        {
+            std::deque<Idle_Connection> connections;
+            std::mutex lock;
+        };
+
+        // Index of the shard the calling thread returns connections to.
+        size_t home_shard();
+
+        // Takes a live cached connection according to the reuse policy, trying the calling
+        // thread's shard first, and stops its timer. Returns null when every shard is empty.
+        // Dead connections found on the way are closed and counted in discarded; the caller
+        // must release their slots once it holds no lock.
+        std::unique_ptr<net::Tcp> take_cached_connection(size_t& discarded);
+
+        // Releases the slots of closed connections.
+        void release_connection_slots(size_t count);
+
+        // Closes every cached connection that fails the liveness probe and arms the next
+        // sweep, unless fired_timer is no longer the current sweep timer.
+        void sweep(Timer_Wheel::Timer_Id_t fired_timer);
+
+        // Only call this with sweep_lock acquired.
+        void arm_sweep();
+
+        // Takes a slot for a new connection if the pool, and its manager's budget, allow it.
+        // Only call this with waiters_lock acquired.
+        bool reserve_connection_slot();
+
+        // Caches the connection then hands cached connections to waiters, if any.
         void put_connection(std::unique_ptr<net::Tcp> tcp_client);
 
-        void handle_remove_connection(const boost::system::error_code&);
-        void remove_connection();
+        // Expires the connection going idle in shard.
+        Timer_Wheel::Timer_Id_t arm_idle_timer(size_t shard);
+
+        // Hands cached connections to waiters until either runs out.
+        void serve_waiters();
+
+        // Gives up the slot of a connection that was closed, or failed to open, and opens a
+        // new one for the first waiter of this pool, or of any pool sharing its manager.
+        void release_connection_slot();
+
+        // Opens connections in the background until the idle floor is met or no slot is left.
+        void replenish();
+
+        // Cheap check for get() that only replenishes when the pool is below its idle floor.
+        void keep_min_idle()
+            { if (min_idle > 0 and idle_connections + warming_connections < min_idle) replenish(); }
+
+        // Opens a new connection for the first waiter if a slot can be reserved.
+        bool open_slot_for_waiter();
 
-        // Queue of cached connections. The top connection is the oldest. The bottom
-        // connection is the youngest.
-        std::queue<Timed_Tcp_Connection_t> connections;
-        std::mutex connections_lock;
+        // Used by the manager to find and close the least recently used idle connection
+        // across its pools. The evicted connection's slot is handed to the caller instead of
+        // being released. oldest_idle_since() is not_a_date_time when nothing is cached.
+        boost::posix_time::ptime oldest_idle_since();
+        Idle_Shard* shard_with_oldest_idle(boost::posix_time::ptime& idle_since);
+        std::unique_ptr<net::Tcp> evict_oldest_idle();
+
+        // Resolution of the idle timers for a pool timeout.
+        static boost::posix_time::time_duration idle_timer_tick(
+                boost::posix_time::time_duration timeout);
+
+        // Closes the connection whose idle timer expired, if it's still cached.
+        void remove_connection(size_t shard, Timer_Wheel::Timer_Id_t expired_timer);
+
+        void handle_acquire_timeout(const boost::system::error_code& ec, uint64_t waiter_id);
+
+        // Needed to execute deadline timers and disconnect connections. Declared first so
+        // it outlives the timers and connections below.
+        std::shared_ptr<Io_Service_Manager> io_service_manager;
+        const bool shared_io_service;
+
+        // Expires idle connections and runs the sweep. See Timer_Wheel::shared().
+        std::shared_ptr<Timer_Wheel> idle_timers;
+
+        std::vector<std::unique_ptr<Idle_Shard>> idle_shards;
+        std::atomic<Reuse_Policy_t> reuse_policy;
+
+        // Warming. idle_connections mirrors the total size of the shards so get() can check
+        // the floor without locking them.
+        std::atomic<size_t> min_idle;
+        std::atomic<size_t> idle_connections;
+        std::atomic<size_t> warming_connections;
+
+        // Sweeping.
+        boost::posix_time::time_duration sweep_interval;
+        Timer_Wheel::Timer_Id_t sweep_timer;
+        bool sweep_armed;
+        std::mutex sweep_lock;
+
+        // Null for a pool created on its own.
+        const std::weak_ptr<Tcp_Pool_Manager> manager;
+
+        // Bounding. Guarded by waiters_lock, which is only taken on a pool miss or while
+        // callers are waiting. waiter_count mirrors waiters.size() so guards returning
+        // connections can skip the lock when nobody waits. open_connections is atomic since
+        // the manager evicts connections without taking waiters_lock.
+        size_t max_connections;
+        std::atomic<size_t> open_connections;
+        std::list<Waiter> waiters;
+        std::atomic<size_t> waiter_count;
+        uint64_t next_waiter_id;
+        std::mutex waiters_lock;
 
         const std::string host;
         const std::string service;
         const boost::posix_time::time_duration timeout;
-
-        // Needed to execute deadline timers and disconnect connections.
-        Io_Service_Manager io_service_manager;
+        const Socket_Options socket_options;
 };
 
 class Tcp_Pool::Tcp_Guard
@@ -95,6 +320,10 @@ class Tcp_Pool::Tcp_Guard
         Tcp_Guard(const Tcp_Guard&) = delete;
         Tcp_Guard& operator=(const Tcp_Guard&) = delete;
 
+        // False for a moved-from guard or one handed out on error.
+        explicit operator bool() const
+            { return tcp_client != nullptr; }
+
         Tcp& operator*()
             { return *tcp_client; }
         Tcp* operator->()
@@ -0,0 +1,117 @@
+#ifndef CPP_NETWORKING_TCP_POOL_MANAGER_H
+#define CPP_NETWORKING_TCP_POOL_MANAGER_H
+
+#include "io_service_manager.h"
+#include "tcp_pool.h"
+#include "timer_wheel.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/future.hpp>
+
+/* Tcp_Pool_Manager
+ *
+ * Overview:
+ * Manages one Tcp_Pool per (host, service) pair for clients talking to many upstreams.
+ *
+ * Behavior:
+ * Pools are created on first use and live as long as the manager. Every pool runs on the
+ * manager's io_service and expires idle connections on one shared Timer_Wheel, so adding a
+ * host doesn't add a worker thread or timer.
+ *
+ * max_connections is a budget of open connections shared by every host and
+ * max_connections_per_host caps each pool, 0 leaves either unbounded. When a pool needs a
+ * new connection while the budget is spent, the least recently used idle connection of any
+ * host is closed and its slot reused. With no idle connection to close the caller waits like
+ * it would at its pool's cap, and gets the next slot freed on any host. Connections returned
+ * while callers wait on the budget are closed to free a slot rather than cached.
+ *
+ * Design:
+ * Implemented the named creation design pattern like Tcp_Pool. The manager tracks the budget
+ * and pools call into it only when they open or close a connection, so taking and returning
+ * cached connections stays on the pool's sharded fast path.
+ *
+ */
+
+namespace net
+{
+
+class Tcp_Pool_Manager : public std::enable_shared_from_this<Tcp_Pool_Manager>
+{
+    public:
+        static std::shared_ptr<Tcp_Pool_Manager> create(
+                boost::posix_time::time_duration idle_timeout,
+                size_t max_connections,
+                size_t max_connections_per_host);
+
+        // Create a manager whose pools run on a shared io_service.
+        static std::shared_ptr<Tcp_Pool_Manager> create(
+                boost::posix_time::time_duration idle_timeout,
+                size_t max_connections,
+                size_t max_connections_per_host,
+                std::shared_ptr<Io_Service_Manager> shared_io_service);
+
+        // Returns the pool for host and service, creating it if needed.
+        std::shared_ptr<Tcp_Pool> get_pool(const std::string& host, const std::string& service);
+
+        // Same as Tcp_Pool::get() and async_get() on get_pool(host, service).
+        // XXX blocking
+        Tcp_Pool::Tcp_Guard get(const std::string& host, const std::string& service);
+        boost::future<Tcp_Pool::Tcp_Guard> async_get(const std::string& host,
+                                                      const std::string& service);
+        void async_get(const std::string& host, const std::string& service,
+                       Tcp_Pool::Get_Handler_t handler);
+
+        // Connections open across every host, cached or held by a guard.
+        size_t open_count();
+
+        size_t pool_count();
+
+    private:
+        friend class Tcp_Pool;
+
+        Tcp_Pool_Manager(boost::posix_time::time_duration idle_timeout,
+                         size_t max_connections,
+                         size_t max_connections_per_host,
+                         std::shared_ptr<Io_Service_Manager> io_service_manager);
+
+        // Called by a pool before opening a connection. Closes the least recently used idle
+        // connection when the budget is spent. Returns false if there was none to close.
+        bool reserve_connection();
+
+        // Called by a pool after a connection is closed, or fails to open. Opens new
+        // connections for callers waiting on any pool.
+        void release_connection();
+
+        // True while callers may be waiting on the budget.
+        bool starved() const
+            { return budget_starved; }
+
+        std::vector<std::shared_ptr<Tcp_Pool>> all_pools();
+
+        // Declared first so it outlives the pools and timers below.
+        std::shared_ptr<Io_Service_Manager> io_service_manager;
+        std::shared_ptr<Timer_Wheel> idle_timers; // shared with the pools, see Timer_Wheel::shared()
+
+        const boost::posix_time::time_duration idle_timeout;
+        const size_t max_connections;
+        const size_t max_connections_per_host;
+
+        size_t open_connections;
+        std::atomic<bool> budget_starved;
+
+        std::map<std::pair<std::string, std::string>, std::shared_ptr<Tcp_Pool>> pools;
+        std::mutex lock;
+};
+
+} // net
+
+#endif
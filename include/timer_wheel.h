@@ -0,0 +1,129 @@
+#ifndef CPP_NETWORKING_TIMER_WHEEL_H
+#define CPP_NETWORKING_TIMER_WHEEL_H
+
+/* Timer_Wheel
+ *
+ * Overview:
+ * A hashed timer wheel that runs many coarse timers off a single deadline_timer.
+ *
+ * Behavior:
+ * Time is divided into ticks and the wheel into a ring of slots, one per tick. arm() rounds
+ * the delay up to whole ticks and files the timer in the slot that many ticks ahead of the
+ * cursor, along with the number of full turns of the wheel it must wait. Every tick the
+ * cursor advances one slot and fires the timers in it that have no turns left. Arming and
+ * cancelling are O(1) and no per timer io_service work is queued.
+ *
+ * Timers fire on the io_service no earlier than their delay and at most one tick late, more
+ * if the io_service is busy. Handlers run outside the wheel's lock so they may arm or cancel
+ * timers. The wheel only waits on its deadline_timer while timers are armed, so it doesn't
+ * keep a Default io_service running.
+ *
+ * Design:
+ * Like Tcp_Pool, instances are created through a static create method and are always held by
+ * a shared pointer. The pending tick only holds a weak reference so a destroyed wheel drops
+ * its timers without firing them. The wheel keeps its Io_Service_Manager alive.
+ *
+ * shared() hands every caller on the same io_service with the same tick one wheel, so a
+ * process runs one deadline_timer per tick resolution instead of one per user. The registry
+ * only holds weak references, so the wheel is destroyed with its last user.
+ *
+ */
+
+#include "io_service_manager.h"
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace net
+{
+
+class Timer_Wheel : public std::enable_shared_from_this<Timer_Wheel>
+{
+    public:
+        using Timer_Id_t = uint64_t;
+
+        // Passed the id arm() returned, so one handler can tell the timers it serves apart.
+        using Handler_t = std::function<void(Timer_Id_t)>;
+
+        // tick must be positive and num_slots non zero.
+        static std::shared_ptr<Timer_Wheel> create(
+                std::shared_ptr<Io_Service_Manager> io_service_manager,
+                boost::posix_time::time_duration tick,
+                size_t num_slots = 512);
+
+        // The wheel shared by every caller passing the same io_service_manager and tick.
+        // Creates it on first use. tick must be positive.
+        static std::shared_ptr<Timer_Wheel> shared(
+                std::shared_ptr<Io_Service_Manager> io_service_manager,
+                boost::posix_time::time_duration tick);
+
+        ~Timer_Wheel();
+
+        // Calls handler on the io_service once delay has passed.
+        Timer_Id_t arm(boost::posix_time::time_duration delay, Handler_t handler);
+
+        // Returns false if the timer already fired, or is firing, or was cancelled before.
+        bool cancel(Timer_Id_t id);
+
+        // Timers armed that haven't fired or been cancelled.
+        size_t pending();
+
+        boost::posix_time::time_duration get_tick() const
+            { return tick; }
+
+    private:
+        Timer_Wheel(std::shared_ptr<Io_Service_Manager> io_service_manager,
+                    boost::posix_time::time_duration tick,
+                    size_t num_slots);
+
+        struct Entry
+        {
+            Timer_Id_t id;
+            size_t rounds; // full turns of the wheel left before firing
+            Handler_t handler;
+        };
+
+        using Slot_t = std::list<Entry>;
+
+        // Waits for the next tick. Only call this with lock acquired.
+        void schedule_tick();
+
+        // Advances the cursor over every tick that has passed and fires the due timers.
+        void handle_tick(const boost::system::error_code& ec);
+
+        // Declared first so it outlives tick_timer.
+        std::shared_ptr<Io_Service_Manager> io_service_manager;
+        boost::asio::deadline_timer tick_timer;
+
+        const boost::posix_time::time_duration tick;
+        std::vector<Slot_t> slots;
+        std::unordered_map<Timer_Id_t, std::pair<size_t, Slot_t::iterator>> index;
+
+        size_t cursor;
+        boost::posix_time::ptime next_tick;
+        bool ticking;
+        Timer_Id_t next_id;
+
+        std::mutex lock;
+
+        // Wheels handed out by shared(), keyed by their io_service manager and tick in
+        // microseconds. A live wheel keeps its manager alive, so a key is never reused while
+        // its wheel exists.
+        using Registry_Key_t = std::pair<const Io_Service_Manager*, int64_t>;
+        static std::map<Registry_Key_t, std::weak_ptr<Timer_Wheel>> registry;
+        static std::mutex registry_lock;
+};
+
+} // net
+
+#endif
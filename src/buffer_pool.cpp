@@ -0,0 +1,192 @@
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+using boost::asio::streambuf;
+
+using net::Buffer_Pool;
+
+using std::unique_ptr;
+using std::vector;
+
+// Settings for the process wide pool.
+static const vector<size_t> default_chunk_sizes_c = { 512, 4096, 65536 };
+static const size_t default_max_cached_per_thread_c = 64;
+
+// Most shared pointer control blocks each thread keeps for reuse.
+static const size_t max_free_blocks_c = 1024;
+
+static std::atomic<uint64_t> next_pool_id(0);
+
+// Every pool's free lists for the current thread, keyed by pool id.
+static thread_local std::unordered_map<uint64_t, vector<vector<unique_ptr<streambuf>>>>
+    thread_pools;
+
+namespace
+{
+
+// Allocates fixed size blocks from a per thread free list. Used for the shared pointer control
+// blocks of pooled buffers so handing out a buffer does not allocate either.
+template <typename T>
+struct Block_Allocator
+{
+    using value_type = T;
+
+    Block_Allocator() = default;
+    template <typename U> Block_Allocator(const Block_Allocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        auto& blocks = free_blocks();
+        if (n == 1 and !blocks.empty())
+        {
+            void* block = blocks.back();
+            blocks.pop_back();
+            return static_cast<T*>(block);
+        }
+
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        auto& blocks = free_blocks();
+        if (n == 1 and blocks.size() < max_free_blocks_c)
+        {
+            blocks.push_back(p);
+            return;
+        }
+
+        ::operator delete(p);
+    }
+
+    // Frees the cached blocks when the thread exits.
+    struct Free_Blocks : vector<void*>
+    {
+        Free_Blocks() { reserve(max_free_blocks_c); }
+        ~Free_Blocks() { for (void* block : *this) ::operator delete(block); }
+    };
+
+    static Free_Blocks& free_blocks()
+    {
+        static thread_local Free_Blocks blocks;
+        return blocks;
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const Block_Allocator<T>&, const Block_Allocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const Block_Allocator<T>&, const Block_Allocator<U>&) { return false; }
+
+vector<size_t> sorted(vector<size_t> sizes)
+{
+    if (sizes.empty())
+    {
+        throw std::invalid_argument("Buffer_Pool: at least one chunk size is required");
+    }
+
+    std::sort(sizes.begin(), sizes.end());
+    return sizes;
+}
+
+} // anonymous
+
+Buffer_Pool::Buffer_Pool(vector<size_t> chunk_sizes_, size_t max_cached_per_thread_)
+    : chunk_sizes(sorted(std::move(chunk_sizes_))),
+      max_cached_per_thread(max_cached_per_thread_),
+      id(next_pool_id++)
+{}
+
+Buffer_Pool& Buffer_Pool::get()
+{
+    static Buffer_Pool pool(default_chunk_sizes_c, default_max_cached_per_thread_c);
+    return pool;
+}
+
+Buffer_Pool::Buffer_t Buffer_Pool::acquire(size_t size_hint)
+{
+    auto deleter = [this] (streambuf* buf) { release(buf); };
+    size_t slab = class_for(size_hint);
+
+    if (slab == chunk_sizes.size())
+    {
+        auto buf = new streambuf();
+        buf->prepare(size_hint);
+        return Buffer_t(buf, deleter, Block_Allocator<streambuf>());
+    }
+
+    auto& free_list = thread_free_lists()[slab];
+    if (!free_list.empty())
+    {
+        auto buf = free_list.back().release();
+        free_list.pop_back();
+        return Buffer_t(buf, deleter, Block_Allocator<streambuf>());
+    }
+
+    // Reserve the whole chunk up front. Nothing is committed so the buffer stays empty.
+    auto buf = new streambuf();
+    buf->prepare(chunk_sizes[slab]);
+    return Buffer_t(buf, deleter, Block_Allocator<streambuf>());
+}
+
+size_t Buffer_Pool::cached()
+{
+    size_t count = 0;
+    for (auto& free_list : thread_free_lists())
+    {
+        count += free_list.size();
+    }
+    return count;
+}
+
+Buffer_Pool::Free_Lists_t& Buffer_Pool::thread_free_lists()
+{
+    auto& free_lists = thread_pools[id];
+    if (free_lists.empty())
+    {
+        free_lists.resize(chunk_sizes.size());
+        for (auto& free_list : free_lists)
+        {
+            free_list.reserve(max_cached_per_thread);
+        }
+    }
+    return free_lists;
+}
+
+size_t Buffer_Pool::class_for(size_t size) const
+{
+    return std::lower_bound(chunk_sizes.begin(), chunk_sizes.end(), size) - chunk_sizes.begin();
+}
+
+void Buffer_Pool::release(streambuf* buf)
+{
+    unique_ptr<streambuf> owned(buf);
+    owned->consume(owned->size());
+
+    // A buffer belongs to the largest class it still has room for. Buffers that grew past
+    // the largest chunk size are freed so idle memory stays bounded.
+    size_t capacity = owned->capacity();
+    if (capacity > chunk_sizes.back() or capacity < chunk_sizes.front())
+    {
+        return;
+    }
+
+    size_t slab = std::upper_bound(chunk_sizes.begin(), chunk_sizes.end(), capacity)
+                  - chunk_sizes.begin() - 1;
+
+    auto& free_list = thread_free_lists()[slab];
+    if (free_list.size() < max_cached_per_thread)
+    {
+        free_list.push_back(std::move(owned));
+    }
+}
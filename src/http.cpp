@@ -1,5 +1,6 @@
 #include "http.h"
 
+#include <algorithm>
 #include <future>
 #include <istream>
 #include <map>
@@ -17,13 +18,18 @@ using boost::asio::const_buffer;
 using boost::asio::mutable_buffer;
 using boost::asio::read_until;
 using boost::asio::streambuf;
+using boost::asio::yield_context;
 using boost::future;
 using boost::system::error_code;
 using boost::system::system_error;
 
 using net::Http;
 using net::Http_Response;
+using net::Tcp;
+using net::Tcp_Pool;
 
+using std::make_shared;
+using std::shared_ptr;
 using std::string;
 using std::vector;
 
@@ -40,16 +46,91 @@ static const char* patch_c = "PATCH";
 string create_request_head(const string& method, const string& path);
 
 // Given a buffer with HTTP response data this returns a single line
-// stipped of the ending \r\n.
+// stipped of the ending \r\n and removes it from the buffer.
 static string get_response_line(string& data)
 {
-    // TODO
-    return http_version_c ;
+    size_t end = data.find("\r\n");
+    if (end == string::npos)
+    {
+        end = data.size();
+    }
+
+    string line = data.substr(0, end);
+    data.erase(0, std::min(end + 2, data.size()));
+    return line;
 }
 
 // Use same buffer for empty contents in requests and responses.
 static const_buffer no_body;
 
+bool net::Header_Name_Less::operator()(const string& a, const string& b) const
+{
+    return boost::algorithm::ilexicographical_compare(a, b);
+}
+
+// Waits for a pooled connection, suspending the coroutine instead of blocking its thread
+// while the pool is at its cap. Shared since the coroutine's result has to be copyable.
+static shared_ptr<Tcp_Pool::Tcp_Guard> await_connection(Tcp_Pool& tcp_pool, yield_context yield)
+{
+    using Guard_Ptr_t = shared_ptr<Tcp_Pool::Tcp_Guard>;
+    boost::asio::async_completion<yield_context, void(error_code, Guard_Ptr_t)> init(yield);
+    auto handler = init.completion_handler;
+    tcp_pool.async_get([handler] (const error_code& ec, Tcp_Pool::Tcp_Guard guard)
+        {
+            // Resume on the coroutine's strand instead of the pool's worker.
+            auto resume = handler;
+            auto tcp_client = make_shared<Tcp_Pool::Tcp_Guard>(std::move(guard));
+            boost::asio::dispatch(boost::asio::get_associated_executor(resume),
+                                  [resume, ec, tcp_client] () mutable { resume(ec, tcp_client); });
+        }
+    );
+    return init.result.get();
+}
+
+// Reads the body of res. Returns false if the connection can't carry another request
+// afterwards, because the body was left unread or ended with the connection.
+static bool read_body(const string& method, Http_Response& res, Tcp& tcp_client,
+                      yield_context yield)
+{
+    // Responses to HEAD, and 1xx, 204 and 304 responses, never have a body.
+    size_t code_begin = res.status.find(' ');
+    string code = code_begin == string::npos ? "" : res.status.substr(code_begin + 1, 3);
+    if (method == head_c or code[0] == '1' or code == "204" or code == "304")
+    {
+        return true;
+    }
+
+    // XXX chunked transfer encoding
+    if (res.headers.count("Transfer-Encoding"))
+    {
+        return false;
+    }
+
+    auto content_length = res.headers.find("Content-Length");
+    if (content_length != res.headers.end())
+    {
+        size_t length = std::stoul(content_length->second);
+        if (length > 0)
+        {
+            res.body = *tcp_client.receive(length, yield);
+        }
+        return true;
+    }
+
+    // Without a length the body ends when the server closes the connection.
+    error_code ec;
+    shared_ptr<string> body = tcp_client.receive(yield[ec]);
+    if (ec and ec != boost::asio::error::eof)
+    {
+        throw system_error(ec);
+    }
+    if (body)
+    {
+        res.body = *body;
+    }
+    return false;
+}
+
 Http::Http(const string& host_, const string& service_)
     : host(host_),
       service(service_),
@@ -76,6 +157,37 @@ future<Http_Response> Http::request(const string& method, const string& path, co
     return fut;
 }
 
+Http_Response Http::request(const string& method, const string& path, const string& body,
+                            yield_context yield)
+{
+    auto tcp_guard = await_connection(*tcp_pool, yield);
+    Tcp& tcp_client = **tcp_guard;
+
+    // The guard puts open connections back in the pool, so any connection left in the middle
+    // of a response is closed first.
+    try
+    {
+        string req_head = create_request_head(method, path);
+        req_head += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        tcp_client.send(vector<const_buffer>{ buffer(req_head), buffer(body) }, yield);
+
+        // Status line and headers
+        shared_ptr<string> res_head = tcp_client.receive(string("\r\n\r\n"), yield);
+        Http_Response res = make_response(*res_head);
+
+        if (!read_body(method, res, tcp_client, yield))
+        {
+            tcp_client.close();
+        }
+        return res;
+    }
+    catch (...)
+    {
+        tcp_client.close();
+        throw;
+    }
+}
+
 /*
 future<Http_Response> Http::request(const string& method, const string& path, const string& body)
 {
@@ -194,16 +306,59 @@ future<Http_Response> Http::patch(const string& path, const_buffer& body)
     // XXX cache response?
 }
 
+Http_Response Http::get(const string& path, yield_context yield)
+{
+    return request(get_c, path, "", yield);
+}
+
+Http_Response Http::head(const string& path, yield_context yield)
+{
+    return request(head_c, path, "", yield);
+}
+
+Http_Response Http::post(const string& path, const string& body, yield_context yield)
+{
+    return request(post_c, path, body, yield);
+}
+
+Http_Response Http::put(const string& path, const string& body, yield_context yield)
+{
+    return request(put_c, path, body, yield);
+}
+
+Http_Response Http::delet(const string& path, yield_context yield)
+{
+    return request(delete_c, path, "", yield);
+}
+
+Http_Response Http::trace(const string& path, yield_context yield)
+{
+    return request(trace_c, path, "", yield);
+}
+
+Http_Response Http::options(const string& path, yield_context yield)
+{
+    return request(options_c, path, "", yield);
+}
+
+Http_Response Http::patch(const string& path, const string& body, yield_context yield)
+{
+    return request(patch_c, path, body, yield);
+}
+
 string Http::create_request_head(const string& method, const string& path)
 {
     // Method
     string req = method + " " + path + " " + http_version_c + "\r\n";
 
     // Headers
-    // XXX does this copy the headers or reference it?
-    for (auto h : headers)
+    if (headers.find("Host") == headers.end())
+    {
+        req += "Host: " + host + "\r\n";
+    }
+    for (const auto& h : headers)
     {
-        // req << h.first << ": " << h.second << "\r\n";
+        req += h.first + ": " + h.second + "\r\n";
     }
 
     // Spacer
@@ -229,22 +384,25 @@ Http_Response Http::make_response(string& data)
             // stop at spacer
             break;
         }
-        std::vector<string> tokens;
-        boost::split(tokens, line, boost::is_any_of(":"));
-
-        // XXX what if the line isn't a valid header?
-        // check for proper form of re.match(".+:.+", line)
+        // Split on the first colon only; values such as dates contain colons too.
+        size_t colon = line.find(':');
+        if (colon == string::npos)
+        {
+            // XXX what if the line isn't a valid header?
+            continue;
+        }
+        string name = line.substr(0, colon);
+        string value = line.substr(colon + 1);
 
         // Strip any surrounding whitespace
-        boost::trim(tokens[0]);
-        boost::trim(tokens[1]);
+        boost::trim(name);
+        boost::trim(value);
 
-        res.headers[tokens[0]] = tokens[1];
+        res.headers[name] = value;
     }
 
     // Body
-    // XXX won't compile
-    // res.body = data;
+    res.body = data;
 
     return res;
 }
@@ -3,8 +3,14 @@
 #include "logger.h"
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #include "boost_config.h"
 #include <boost/asio.hpp>
 #include <boost/thread/future.hpp>
@@ -23,10 +29,15 @@ using std::unique_lock;
 
 Io_Service_Manager::Io_Service_Manager() : Io_Service_Manager(Behavior_t::Default) {}
 
-Io_Service_Manager::Io_Service_Manager(Behavior_t b)
+Io_Service_Manager::Io_Service_Manager(Behavior_t b) : Io_Service_Manager(b, 1) {}
+
+Io_Service_Manager::Io_Service_Manager(Behavior_t b, size_t workers)
     : behavior(b),
       state(State_t::Stopped),
-      io_thread_worker()
+      num_workers(workers ? workers : std::max(1u, thread::hardware_concurrency())),
+      cpu_affinity(-1),
+      io_service(make_shared<boost::asio::io_service>()),
+      io_thread_workers()
 {
     // Top level state change function. Everything must be atomic.
     lock_guard<mutex> lck(state_change_lock);
@@ -49,10 +60,7 @@ Io_Service_Manager::~Io_Service_Manager()
 
     // Even if workers are no longer running, the threads still need to be joined
     // to properly clean them up.
-    if (io_thread_worker and io_thread_worker->joinable())
-    {
-        io_thread_worker->join();
-    }
+    join_workers();
 }
 
 void Io_Service_Manager::start()
@@ -67,11 +75,21 @@ void Io_Service_Manager::stop()
 {
     // Top level state change function. Everything must be atomic.
     lock_guard<mutex> lck(state_change_lock);
+
+    // The worker would have to join itself. A handler that owns the manager can release it
+    // instead, see ~Io_Service_Manager().
+    if (in_worker_thread())
+    {
+        logic_error e("Io_Service_Manager can't be stopped by one of its workers");
+        Logger::get()->warn(e.what());
+        throw e;
+    }
+
     to_stop_state();
     service_stopped_cv.notify_all();
 }
 
-// Start service by adding the first worker.
+// Start service by adding all workers.
 void Io_Service_Manager::to_start_state()
 {
     if (is_running())
@@ -83,11 +101,16 @@ void Io_Service_Manager::to_start_state()
 
     if (is_perpetual())
     {
-        io_work = make_shared<io_service::work>(io_service);
+        io_work = make_shared<io_service::work>(*io_service);
+    }
+
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        auto worker = make_shared<thread>(std::bind(&Io_Service_Manager::run_worker, io_service));
+        apply_cpu_affinity(*worker);
+        io_thread_workers.push_back(worker);
     }
 
-    io_thread_worker = make_shared<thread>(std::bind(&Io_Service_Manager::run_worker, this));
-    
     state = State_t::Running;
 }
 
@@ -110,47 +133,89 @@ void Io_Service_Manager::to_stop_state()
         io_work.reset();
     }
 
+    // Only the destructor gets here on a worker, and that worker is still inside run().
+    bool from_worker = in_worker_thread();
+
     // Stop service and all worker threads.
-    io_service.stop();
+    io_service->stop();
 
     // Stop and join worker threads.
-    if (io_thread_worker and io_thread_worker->joinable())
+    join_workers();
+
+    // Prepare service to startup again.
+    if (!from_worker)
     {
-        io_thread_worker->join();
-        io_thread_worker.reset();
+        io_service->reset();
     }
-    else
+
+    state = State_t::Stopped;
+}
+
+void Io_Service_Manager::pin_workers(unsigned cpu)
+{
+    lock_guard<mutex> lck(state_change_lock);
+
+    cpu_affinity = cpu;
+    for (auto& worker : io_thread_workers)
     {
-        Logger::get()->warn("Io_Service_Manager::to_stop_state() io_thread_worker not joined");
+        apply_cpu_affinity(*worker);
     }
+}
 
-    // Prepare service to startup again.
-    io_service.reset();
+void Io_Service_Manager::apply_cpu_affinity(thread& worker)
+{
+    if (cpu_affinity < 0)
+    {
+        return;
+    }
 
-    state = State_t::Stopped;
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu_affinity, &cpus);
+
+    int err = pthread_setaffinity_np(worker.native_handle(), sizeof(cpu_set_t), &cpus);
+    if (err)
+    {
+        Logger::get()->warn("Io_Service_Manager: failed to pin worker to cpu {}: {}",
+                            cpu_affinity, std::strerror(err));
+    }
+#else
+    Logger::get()->warn("Io_Service_Manager: cpu pinning is not supported on this platform");
+#endif
+}
+
+void Io_Service_Manager::join_workers()
+{
+    for (auto& worker : io_thread_workers)
+    {
+        // A worker can't join itself. This happens when a handler releases the last
+        // reference to the manager so leave it to exit once run() returns. It holds its own
+        // reference to the io_service until then.
+        if (worker->get_id() == boost::this_thread::get_id())
+        {
+            Logger::get()->warn("Io_Service_Manager: worker destroyed its own service; detaching");
+            worker->detach();
+        }
+        else if (worker->joinable())
+        {
+            worker->join();
+        }
+    }
+
+    io_thread_workers.clear();
 }
 
-void Io_Service_Manager::run_worker()
+void Io_Service_Manager::run_worker(std::shared_ptr<boost::asio::io_service> service)
 {
     // Blocks until all work is done.
     // If this Io_Service_Manager is perpetual it will run until either:
     //     1. io_work is destroyed, and all work is completed
     //     2. io_service is stopped
-    Io_Service_Manager::io_service.run();
-
-    // XXX not clean
-    std::string state_str;
-    switch (state)
-    {
-        case State_t::Running:
-            state_str = "running";
-            break;
-        case State_t::Stopped:
-            state_str = "stopped";
-            break;
-    }
+    // The manager may be gone by the time run() returns so it is not touched here.
+    service->run();
 
-    Logger::get()->trace("Io_Service_Manager: worker exiting at state: {}", state_str);
+    Logger::get()->trace("Io_Service_Manager: worker exiting");
 }
 
 // XXX unused; untested
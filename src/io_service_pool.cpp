@@ -0,0 +1,138 @@
+#include "io_service_pool.h"
+
+#include "io_service_manager.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "boost_config.h"
+#include <boost/thread.hpp>
+
+using net::Io_Service_Manager;
+using net::Io_Service_Pool;
+
+using std::make_shared;
+using std::shared_ptr;
+using std::vector;
+
+Io_Service_Pool::Io_Service_Pool() : Io_Service_Pool(0, Placement_t::Round_Robin, true) {}
+
+Io_Service_Pool::Io_Service_Pool(size_t num_shards, Placement_t placement_, bool pin_workers)
+    : placement(placement_),
+      next_shard(0)
+{
+    vector<unsigned> cpus = allowed_cpus();
+    if (num_shards == 0)
+    {
+        num_shards = cpus.size();
+    }
+
+    for (size_t i = 0; i < num_shards; ++i)
+    {
+        auto shard = make_shared<Shard>();
+        shard->service = make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual, 1);
+        shard->load = 0;
+        if (pin_workers)
+        {
+            shard->service->pin_workers(cpus[i % cpus.size()]);
+        }
+        shards.push_back(shard);
+    }
+
+    Logger::get()->debug("Io_Service_Pool: started {} shards", shards.size());
+}
+
+Io_Service_Pool::~Io_Service_Pool()
+{
+    for (auto& shard : shards)
+    {
+        // A shard's worker releasing the pool leaves its shard to stop once released too.
+        if (shard->service->is_running() and !shard->service->in_worker_thread())
+        {
+            shard->service->stop();
+        }
+    }
+}
+
+shared_ptr<Io_Service_Manager> Io_Service_Pool::next()
+{
+    switch (placement)
+    {
+        case Placement_t::Least_Loaded:
+        {
+            // Start the search at a rotating offset so ties are spread across shards.
+            size_t start = next_shard++;
+            size_t best = start % shards.size();
+            for (size_t n = 1; n < shards.size(); ++n)
+            {
+                size_t i = (start + n) % shards.size();
+                if (load(i) < load(best))
+                {
+                    best = i;
+                }
+            }
+            return place(best);
+        }
+        case Placement_t::Round_Robin:
+        default:
+            return place(next_shard++ % shards.size());
+    }
+}
+
+shared_ptr<Io_Service_Manager> Io_Service_Pool::place(size_t i)
+{
+    // The placement gets its own control block, so it and its copies count once and the
+    // count drops when the last of them is released.
+    auto shard = shards.at(i);
+    ++shard->load;
+    return shared_ptr<Io_Service_Manager>(shard->service.get(),
+        [shard] (Io_Service_Manager*)
+        {
+            --shard->load;
+        }
+    );
+}
+
+vector<unsigned> Io_Service_Pool::allowed_cpus()
+{
+    vector<unsigned> cpus;
+
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0)
+    {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    else
+    {
+        Logger::get()->warn("Io_Service_Pool: failed to read the cpu affinity: {}",
+                            std::strerror(errno));
+    }
+#endif
+
+    // Without an affinity mask assume every hardware thread is available.
+    if (cpus.empty())
+    {
+        unsigned num_cpus = std::max(1u, boost::thread::hardware_concurrency());
+        for (unsigned cpu = 0; cpu < num_cpus; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
@@ -0,0 +1,163 @@
+#include "resolver_cache.h"
+
+#include "logger.h"
+
+#include <mutex>
+#include <string>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+using boost::asio::ip::tcp;
+using boost::posix_time::microsec_clock;
+using boost::posix_time::time_duration;
+using boost::system::error_code;
+
+using net::Resolver_Cache;
+
+using std::lock_guard;
+using std::mutex;
+using std::string;
+
+// Settings for the process wide cache.
+static const time_duration default_ttl_c = boost::posix_time::seconds(60);
+static const time_duration default_negative_ttl_c = boost::posix_time::seconds(5);
+static const size_t default_max_entries_c = 1024;
+
+Resolver_Cache::Resolver_Cache(time_duration ttl_, time_duration negative_ttl_,
+                               size_t max_entries_)
+    : ttl(ttl_),
+      negative_ttl(negative_ttl_),
+      max_entries(max_entries_)
+{}
+
+Resolver_Cache& Resolver_Cache::get()
+{
+    static Resolver_Cache cache(default_ttl_c, default_negative_ttl_c, default_max_entries_c);
+    return cache;
+}
+
+bool Resolver_Cache::lookup(const string& host, const string& service,
+                            Endpoints_t& endpoints, error_code& ec)
+{
+    lock_guard<mutex> lck(entries_lock);
+
+    auto it = index.find(Key_t(host, service));
+    if (it == index.end())
+    {
+        return false;
+    }
+
+    if (it->second->expires_at <= microsec_clock::universal_time())
+    {
+        entries.erase(it->second);
+        index.erase(it);
+        return false;
+    }
+
+    // Move to the front to mark as most recently used.
+    entries.splice(entries.begin(), entries, it->second);
+
+    endpoints = it->second->endpoints;
+    ec = it->second->error;
+    return true;
+}
+
+void Resolver_Cache::insert(const string& host, const string& service,
+                            const Endpoints_t& endpoints)
+{
+    lock_guard<mutex> lck(entries_lock);
+    store({ Key_t(host, service), endpoints, error_code(),
+            microsec_clock::universal_time() + ttl });
+}
+
+void Resolver_Cache::insert_error(const string& host, const string& service,
+                                  const error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted)
+    {
+        return;
+    }
+
+    lock_guard<mutex> lck(entries_lock);
+    store({ Key_t(host, service), Endpoints_t(), ec,
+            microsec_clock::universal_time() + negative_ttl });
+}
+
+void Resolver_Cache::invalidate(const string& host, const string& service)
+{
+    lock_guard<mutex> lck(entries_lock);
+
+    auto it = index.find(Key_t(host, service));
+    if (it != index.end())
+    {
+        entries.erase(it->second);
+        index.erase(it);
+    }
+}
+
+void Resolver_Cache::clear()
+{
+    lock_guard<mutex> lck(entries_lock);
+    entries.clear();
+    index.clear();
+}
+
+Resolver_Cache::Endpoints_t Resolver_Cache::resolve(boost::asio::io_service& io_service,
+                                                    const string& host, const string& service,
+                                                    error_code& ec)
+{
+    Endpoints_t endpoints;
+    if (lookup(host, service, endpoints, ec))
+    {
+        return endpoints;
+    }
+
+    tcp::resolver resolver(io_service);
+    tcp::resolver::query query(host, service);
+    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query, ec);
+
+    if (ec)
+    {
+        Logger::get()->debug("Resolver_Cache: resolving {}:{} failed: {}",
+                             host, service, ec.message());
+        insert_error(host, service, ec);
+        return endpoints;
+    }
+
+    tcp::resolver::iterator end;
+    endpoints.assign(endpoint_iterator, end);
+    insert(host, service, endpoints);
+    return endpoints;
+}
+
+size_t Resolver_Cache::size()
+{
+    lock_guard<mutex> lck(entries_lock);
+    return entries.size();
+}
+
+void Resolver_Cache::store(Entry entry)
+{
+    auto it = index.find(entry.key);
+    if (it != index.end())
+    {
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    if (max_entries == 0)
+    {
+        return;
+    }
+
+    // Evict the least recently used entries.
+    while (entries.size() >= max_entries)
+    {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+
+    entries.push_front(std::move(entry));
+    index[entries.front().key] = entries.begin();
+}
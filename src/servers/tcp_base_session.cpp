@@ -1,5 +1,6 @@
 #include "servers/tcp_base_session.h"
 
+#include "buffer_pool.h"
 #include "logger.h"
 
 #include <memory>
@@ -12,9 +13,9 @@ using boost::asio::async_read_until;
 using boost::asio::streambuf;
 using boost::system::error_code;
 
+using net::Buffer_Pool;
 using net::Tcp_Base_Session;
 
-using std::make_shared;
 using std::shared_ptr;
 using std::string;
 
@@ -22,12 +23,33 @@ Tcp_Base_Session::Tcp_Base_Session(boost::asio::ip::tcp::socket socket_)
     : socket(std::move(socket_))
 {}
 
+Tcp_Base_Session::Tcp_Base_Session(boost::asio::ip::tcp::socket socket_,
+                                   shared_ptr<net::Io_Service_Manager> io_service_)
+    : io_service(io_service_),
+      socket(std::move(socket_))
+{}
+
 Tcp_Base_Session::~Tcp_Base_Session() {}
 
+void Tcp_Base_Session::recycle()
+{
+    error_code ec;
+    socket.close(ec);
+    io_service.reset();
+    reset();
+}
+
+void Tcp_Base_Session::reuse(boost::asio::ip::tcp::socket socket_,
+                             shared_ptr<net::Io_Service_Manager> io_service_)
+{
+    io_service = io_service_;
+    socket = std::move(socket_);
+}
+
 void Tcp_Base_Session::do_read(const string& pattern)
 {
     auto self(shared_from_this());
-    auto res = make_shared<streambuf>();
+    auto res = Buffer_Pool::get().acquire();
     async_read_until(socket, *res, pattern, [this, self, res]  (const error_code& ec, size_t length)
         {
             Logger::get()->debug(" | read {} bytes", length);
@@ -39,7 +61,7 @@ void Tcp_Base_Session::do_read(const string& pattern)
 void Tcp_Base_Session::do_read(size_t len)
 {
     auto self(shared_from_this());
-    auto res = make_shared<streambuf>();
+    auto res = Buffer_Pool::get().acquire(len);
     async_read(socket, *res, boost::asio::transfer_at_least(len), [this, self, res]
                (const error_code& ec, size_t length)
         {
@@ -53,8 +75,9 @@ void Tcp_Base_Session::do_write(shared_ptr<streambuf> buf)
 {
     auto self(shared_from_this());
 
+    // buf is captured to keep the data alive until the write completes.
     async_write(socket, *buf,
-        [this, self] (error_code ec, std::size_t length) {
+        [this, self, buf] (error_code ec, std::size_t length) {
             // XXX Check ec for client disconnection
             Logger::get()->debug(" | wrote {} bytes", length);
             this->do_write_work(ec, length);
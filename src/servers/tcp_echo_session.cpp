@@ -26,6 +26,13 @@ Tcp_Echo_Session::Tcp_Echo_Session(boost::asio::ip::tcp::socket socket)
     Logger::get()->debug(" | echo session started");
 }
 
+Tcp_Echo_Session::Tcp_Echo_Session(boost::asio::ip::tcp::socket socket,
+                                   shared_ptr<net::Io_Service_Manager> io_service)
+    : net::Tcp_Base_Session(std::move(socket), io_service)
+{
+    Logger::get()->debug(" | echo session started");
+}
+
 void Tcp_Echo_Session::start()
 {
   do_read(pattern);
@@ -5,11 +5,20 @@
 #include "io_service_manager.h"
 #include "servers/tcp_echo_session.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <sys/socket.h>     // SO_REUSEPORT
+
 #include "boost_config.h"
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 
 using net::Io_Service_Manager;
+using net::Io_Service_Pool;
+using net::Socket_Options;
+using net::Tcp_Echo_Session;
 using net::Tcp_Server;
 
 using boost::asio::ip::tcp;
@@ -18,14 +27,107 @@ using boost::system::error_code;
 using std::make_shared;
 using std::shared_ptr;
 
-Tcp_Server::Tcp_Server(Role_t role, short port)
-  : server_role(role),
+#if defined(SO_REUSEPORT)
+using Reuse_Port_t = net::Int_Socket_Option<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+Tcp_Server::Listener::Listener(boost::asio::io_service& acceptor_service)
+  : acceptor(acceptor_service),
+    strand(acceptor_service),
+    socket(acceptor_service),
+    shard(0)
+{}
+
+constexpr size_t Tcp_Server::Session_Factory::default_max_cached_c;
+
+Tcp_Server::Session_Factory::Session_Factory(Role_t role)
+  : Session_Factory(role_sessions(role))
+{}
+
+Tcp_Server::Session_Factory::Session_Factory(Create_Fn_t create_fn)
+  : make_sessions([create_fn] ()
+        {
+            return Sessions {
+                [create_fn] (boost::asio::ip::tcp::socket socket,
+                             shared_ptr<Io_Service_Manager> io_service)
+                    { create_fn(std::move(socket), io_service).start(); },
+                nullptr
+            };
+        })
+{}
+
+Tcp_Server::Session_Factory::Session_Factory(Make_Sessions_Fn_t make_sessions_)
+  : make_sessions(make_sessions_)
+{}
+
+Tcp_Server::Session_Factory::Make_Sessions_Fn_t
+Tcp_Server::Session_Factory::role_sessions(Role_t role)
+{
+    switch(role)
+    {
+        case Role_t::Echo:
+            return pooled_sessions<Tcp_Echo_Session>(default_max_cached_c);
+        default:
+            std::logic_error e("Tcp_Server: invalid server role selected");
+            Logger::get()->warn(e.what());
+            throw e;
+    };
+}
+
+Tcp_Server::Tcp_Server(Session_Factory sessions_, short port, const Socket_Options& options_,
+                       const Accept_Options& accept_options_)
+  : options(options_),
+    accept_options(accept_options_),
     running(true),
-    io_service(Io_Service_Manager::Behavior_t::Perpetual),
-    acceptor(io_service.get(), tcp::endpoint(tcp::v4(), port)),
-    socket(io_service.get())
+    wakeups(0),
+    io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual)),
+    shared_io_service(false),
+    listen_mode(Listen_Mode_t::Single_Acceptor),
+    sessions(sessions_.make_sessions())
 {
-    accept_thread = make_shared<boost::thread>(&Tcp_Server::do_accept, this);
+    listen(port);
+}
+
+Tcp_Server::Tcp_Server(Session_Factory sessions_, short port,
+                       shared_ptr<Io_Service_Manager> shared_io_service_,
+                       const Socket_Options& options_,
+                       const Accept_Options& accept_options_)
+  : options(options_),
+    accept_options(accept_options_),
+    running(true),
+    wakeups(0),
+    io_service(shared_io_service_),
+    shared_io_service(true),
+    listen_mode(Listen_Mode_t::Single_Acceptor),
+    sessions(sessions_.make_sessions())
+{
+    listen(port);
+}
+
+Tcp_Server::Tcp_Server(Session_Factory sessions_, short port,
+                       shared_ptr<Io_Service_Pool> session_services_,
+                       const Socket_Options& options_,
+                       const Accept_Options& accept_options_)
+  : Tcp_Server(sessions_, port, session_services_, Listen_Mode_t::Single_Acceptor, options_,
+               accept_options_)
+{}
+
+Tcp_Server::Tcp_Server(Session_Factory sessions_, short port,
+                       shared_ptr<Io_Service_Pool> session_services_,
+                       Listen_Mode_t mode, const Socket_Options& options_,
+                       const Accept_Options& accept_options_)
+  : options(options_),
+    accept_options(accept_options_),
+    running(true),
+    wakeups(0),
+    io_service(mode == Listen_Mode_t::Reuse_Port ? session_services_->get(0) :
+                                                    session_services_->next()),
+    shared_io_service(true),
+    session_services(session_services_),
+    listen_mode(mode),
+    sessions(sessions_.make_sessions())
+{
+    listen(port);
 }
 
 Tcp_Server::~Tcp_Server()
@@ -38,49 +140,219 @@ Tcp_Server::~Tcp_Server()
 
 void Tcp_Server::stop()
 {
-    io_service.stop();
-
     // Stop accepting new connections
     accept_thread->join();
 
-    // Release socket
-    boost::system::error_code ec;
-    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
-    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_receive, ec);
-    socket.close();
+    if (shared_io_service)
+    {
+        // The services keep running so wait for the cancelled accept handlers to finish
+        // before this object can be destroyed.
+        std::vector<boost::future<void>> stopped;
+        for (auto& listener : listeners)
+        {
+            stopped.push_back(listener->accept_stopped.get_future());
+            Listener* l = listener.get();
+            l->strand.post([l] ()
+                {
+                    error_code ec;
+                    l->acceptor.close(ec);
+                }
+            );
+        }
+        for (auto& f : stopped)
+        {
+            f.wait();
+        }
+    }
+    else
+    {
+        io_service->stop();
+    }
+
+    // Release sockets
+    for (auto& listener : listeners)
+    {
+        boost::system::error_code ec;
+        listener->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+        listener->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_receive, ec);
+        listener->socket.close();
+    }
 
     running = false;
 
     Logger::get()->debug("Tcp_Server: stopping");
 }
 
-void Tcp_Server::do_accept()
+size_t Tcp_Server::cached_sessions()
+{
+    return sessions.cached ? sessions.cached() : 0;
+}
+
+void Tcp_Server::listen(short port)
+{
+    size_t num_listeners = 1;
+    if (listen_mode == Listen_Mode_t::Reuse_Port)
+    {
+#if !defined(SO_REUSEPORT)
+        throw boost::system::system_error(boost::asio::error::operation_not_supported,
+                                          "Tcp_Server: SO_REUSEPORT");
+#endif
+        num_listeners = session_services->size();
+    }
+
+    tcp::endpoint endpoint(tcp::v4(), port);
+    for (size_t i = 0; i < num_listeners; ++i)
+    {
+        auto acceptor_service = listen_mode == Listen_Mode_t::Reuse_Port ?
+                                session_services->get(i) : io_service;
+        listeners.push_back(std::unique_ptr<Listener>(new Listener(acceptor_service->get())));
+        Listener& listener = *listeners.back();
+        listener.shard = i;
+
+        listener.acceptor.open(endpoint.protocol());
+        listener.acceptor.set_option(tcp::acceptor::reuse_address(true));
+#if defined(SO_REUSEPORT)
+        if (listen_mode == Listen_Mode_t::Reuse_Port)
+        {
+            listener.acceptor.set_option(Reuse_Port_t(1));
+        }
+#endif
+
+        error_code ec;
+        options.apply_before_connect(listener.acceptor, ec);
+        if (ec)
+        {
+            Logger::get()->warn("Tcp_Server: failed to set socket buffer sizes: {}", ec.message());
+        }
+
+        listener.acceptor.bind(endpoint);
+        listener.acceptor.listen(accept_options.listen_backlog > 0 ? accept_options.listen_backlog :
+                                 tcp::acceptor::max_listen_connections);
+        if (accept_options.batch_accept)
+        {
+            listener.acceptor.non_blocking(true);
+        }
+    }
+
+    accept_thread = make_shared<boost::thread>([this] ()
+        {
+            for (auto& listener : listeners)
+            {
+                do_accept(*listener);
+            }
+        }
+    );
+}
+
+void Tcp_Server::do_accept(Listener& listener)
 {
     Logger::get()->debug("Waiting for connection...");
-    acceptor.async_accept(socket, [this](error_code ec)
+
+    if (accept_options.batch_accept)
+    {
+        listener.acceptor.async_wait(tcp::acceptor::wait_read, listener.strand.wrap(
+            [this, &listener] (error_code ec)
+            {
+                if (ec == boost::asio::error::operation_aborted or !listener.acceptor.is_open())
+                {
+                    Logger::get()->debug("Tcp_Server: accept loop stopped");
+                    listener.accept_stopped.set_value();
+                    return;
+                }
+
+                if (!ec)
+                {
+                    ++wakeups;
+                    accept_pending(listener);
+                }
+
+                do_accept(listener);
+            }
+        ));
+        return;
+    }
+
+    prepare_socket(listener);
+    listener.acceptor.async_accept(listener.socket, listener.strand.wrap(
+        [this, &listener] (error_code ec)
         {
+            // The acceptor may be closed after this accept completed but before the
+            // handler ran, so check it too or the loop spins on bad_descriptor.
+            if (ec == boost::asio::error::operation_aborted or !listener.acceptor.is_open())
+            {
+                Logger::get()->debug("Tcp_Server: accept loop stopped");
+                listener.accept_stopped.set_value();
+                return;
+            }
+
             Logger::get()->debug("Connection accepted");
             if (!ec)
             {
-                new_connection(std::move(socket));
+                ++wakeups;
+                start_session(listener);
             }
 
             // Call self again for the next incoming connection
-            do_accept();
+            do_accept(listener);
         }
-    );
+    ));
 }
 
-void Tcp_Server::new_connection(boost::asio::ip::tcp::socket s)
+void Tcp_Server::accept_pending(Listener& listener)
 {
-    switch(server_role)
+    // Connections left pending past max_batch make the acceptor readable again right away, so
+    // they're accepted after the handlers queued meanwhile.
+    size_t max_batch = std::max<size_t>(accept_options.max_batch, 1);
+    size_t accepted = 0;
+    while (accepted < max_batch)
     {
-        case Role_t::Echo:
-            make_shared<net::Tcp_Echo_Session>(std::move(s))->start();
+        prepare_socket(listener);
+
+        error_code ec;
+        listener.acceptor.accept(listener.socket, ec);
+        if (ec)
+        {
+            // Anything but an empty backlog is retried on the next wakeup.
+            if (ec != boost::asio::error::would_block and ec != boost::asio::error::try_again)
+            {
+                Logger::get()->debug("Tcp_Server: accept failed: {}", ec.message());
+            }
             break;
-        default:
-            std::logic_error e("Tcp_Server: invalid server role selected");
-            Logger::get()->warn(e.what());
-            throw e;
-    };
+        }
+
+        start_session(listener);
+        ++accepted;
+    }
+
+    Logger::get()->debug("Tcp_Server: accepted {} connections", accepted);
+}
+
+void Tcp_Server::prepare_socket(Listener& listener)
+{
+    // Accept directly onto the shard the new session will run on. A socket readied for an
+    // accept that didn't complete is kept for the next one.
+    if (session_services and !listener.socket_service)
+    {
+        listener.socket_service = listen_mode == Listen_Mode_t::Reuse_Port ?
+                                  session_services->place(listener.shard) :
+                                  session_services->next();
+        listener.socket = tcp::socket(listener.socket_service->get());
+    }
+}
+
+void Tcp_Server::start_session(Listener& listener)
+{
+    error_code ec;
+    options.apply(listener.socket, ec);
+    if (ec)
+    {
+        Logger::get()->warn("Tcp_Server: failed to set socket options: {}", ec.message());
+    }
+    new_connection(std::move(listener.socket), std::move(listener.socket_service));
+}
+
+void Tcp_Server::new_connection(boost::asio::ip::tcp::socket s,
+                                shared_ptr<Io_Service_Manager> s_service)
+{
+    sessions.start(std::move(s), s_service);
 }
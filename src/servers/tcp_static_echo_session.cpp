@@ -0,0 +1,47 @@
+#include "servers/tcp_static_echo_session.h"
+
+#include "logger.h"
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+#include <memory>
+
+using boost::asio::streambuf;
+using boost::system::error_code;
+
+using net::Tcp_Static_Echo_Session;
+
+using std::shared_ptr;
+
+const char* const pattern = "\n";
+
+Tcp_Static_Echo_Session::Tcp_Static_Echo_Session(boost::asio::ip::tcp::socket socket,
+                                                 shared_ptr<net::Io_Service_Manager> io_service)
+    : Tcp_Static_Session(std::move(socket), io_service)
+{
+    Logger::get()->debug(" | static echo session started");
+}
+
+void Tcp_Static_Echo_Session::start()
+{
+    do_read(pattern);
+}
+
+void Tcp_Static_Echo_Session::do_read_work(shared_ptr<streambuf> res, error_code ec)
+{
+    Logger::get()->debug(" | working on read data");
+    if (!ec)
+    {
+        do_write(res);
+    }
+}
+
+void Tcp_Static_Echo_Session::do_write_work(error_code ec, size_t length)
+{
+    Logger::get()->debug(" | working on write data");
+    if (!ec)
+    {
+        do_read(pattern);
+    }
+}
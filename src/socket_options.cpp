@@ -0,0 +1,78 @@
+#include "socket_options.h"
+
+#include <netinet/in.h>     // IPPROTO_TCP
+#include <netinet/tcp.h>    // TCP_QUICKACK
+#include <sys/socket.h>     // setsockopt, SO_BUSY_POLL
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+using boost::asio::ip::tcp;
+using boost::system::error_code;
+
+using net::Int_Socket_Option;
+using net::Socket_Options;
+
+// Sets an option, keeping the first error in ec so the remaining options are still tried.
+template <typename Socket_t, typename Option_t>
+static void set_option(Socket_t& socket, const Option_t& option, error_code& ec)
+{
+    error_code option_ec;
+    socket.set_option(option, option_ec);
+    if (option_ec and !ec)
+    {
+        ec = option_ec;
+    }
+}
+
+template <typename Socket_t>
+static void set_buffer_sizes(const Socket_Options& options, Socket_t& socket, error_code& ec)
+{
+    if (options.receive_buffer_size > 0)
+    {
+        set_option(socket, tcp::socket::receive_buffer_size(options.receive_buffer_size), ec);
+    }
+    if (options.send_buffer_size > 0)
+    {
+        set_option(socket, tcp::socket::send_buffer_size(options.send_buffer_size), ec);
+    }
+}
+
+void Socket_Options::apply_before_connect(tcp::socket& socket, error_code& ec) const
+{
+    set_buffer_sizes(*this, socket, ec);
+}
+
+void Socket_Options::apply_before_connect(tcp::acceptor& acceptor, error_code& ec) const
+{
+    set_buffer_sizes(*this, acceptor, ec);
+}
+
+void Socket_Options::apply(tcp::socket& socket, error_code& ec) const
+{
+    if (no_delay)
+    {
+        set_option(socket, tcp::no_delay(true), ec);
+    }
+    if (keep_alive)
+    {
+        set_option(socket, tcp::socket::keep_alive(true), ec);
+    }
+#ifdef SO_BUSY_POLL
+    if (busy_poll_usec > 0)
+    {
+        set_option(socket, Int_Socket_Option<SOL_SOCKET, SO_BUSY_POLL>(busy_poll_usec), ec);
+    }
+#endif
+    apply_quick_ack(socket, ec);
+}
+
+void Socket_Options::apply_quick_ack(tcp::socket& socket, error_code& ec) const
+{
+#ifdef TCP_QUICKACK
+    if (quick_ack)
+    {
+        set_option(socket, Int_Socket_Option<IPPROTO_TCP, TCP_QUICKACK>(1), ec);
+    }
+#endif
+}
@@ -1,13 +1,18 @@
 #include "tcp.h"
+#include "buffer_pool.h"
 #include "logger.h"
+#include "resolver_cache.h"
 
 #include <algorithm>        // copy
+#include <cerrno>
 #include <functional>
 #include <iterator>         // back_inserter
 #include <memory>
 #include <string>
 #include <vector>
 
+#include <sys/socket.h>     // recv
+
 #include "boost_config.h"
 #include <boost/asio.hpp>
 #include <boost/thread/future.hpp>
@@ -21,11 +26,18 @@ using boost::asio::buffer;
 using boost::asio::buffer_size;
 using boost::asio::buffers_begin;
 using boost::asio::const_buffer;
+using boost::asio::ip::tcp;
 using boost::asio::streambuf;
 using boost::asio::transfer_exactly;
+using boost::asio::yield_context;
+using boost::posix_time::time_duration;
 using boost::system::error_code;
 using boost::system::system_error;
 
+using net::Buffer_Pool;
+using net::Io_Service_Manager;
+using net::Resolver_Cache;
+using net::Socket_Options;
 using net::Tcp;
 
 using std::copy;
@@ -34,16 +46,369 @@ using std::shared_ptr;
 using std::string;
 using std::vector;
 
+// Delay before racing the next endpoint while earlier connection attempts are still in
+// flight. RFC 8305 recommends 250ms.
+static const boost::posix_time::time_duration connection_attempt_delay_c =
+    boost::posix_time::milliseconds(250);
+
+// Starts an operation whose handler resumes the calling coroutine, then suspends the coroutine
+// until the handler runs. Returns the operation's result or throws its error.
+template <typename T, typename Start_Fn>
+static T await_handler(yield_context yield, Start_Fn start)
+{
+    boost::asio::async_completion<yield_context, void(error_code, T)> init(yield);
+    auto handler = init.completion_handler;
+    start([handler] (const error_code& ec, T value)
+        {
+            // Resume on the coroutine's strand instead of whichever worker finished.
+            auto resume = handler;
+            boost::asio::dispatch(boost::asio::get_associated_executor(resume),
+                                  [resume, ec, value] () mutable { resume(ec, value); });
+        }
+    );
+    return init.result.get();
+}
+
+class Tcp::Connector : public std::enable_shared_from_this<Tcp::Connector>
+{
+    public:
+        Connector(std::unique_ptr<Tcp> client_, Connect_Callback_t callback_);
+
+        void start(const string& host, const string& service);
+
+    private:
+        void handle_resolve(const error_code& ec, tcp::resolver::iterator endpoint_iterator);
+
+        // Orders resolved or cached endpoints and starts the first attempt.
+        void handle_endpoints(const error_code& ec, const Resolver_Cache::Endpoints_t& resolved);
+
+        // Starts connecting to the next endpoint and arms the attempt delay timer.
+        void start_next_attempt();
+
+        void handle_attempt_delay(const error_code& ec);
+        void handle_connect(const error_code& ec, shared_ptr<tcp::socket> attempt);
+
+        // Hands the client (or the error) to the callback. Only the first call has effect.
+        void finish(const error_code& ec);
+
+        std::unique_ptr<Tcp> client; // Declared first; every member below uses its service.
+        Connect_Callback_t callback;
+        string host;
+        string service;
+
+        boost::asio::io_service::strand strand;
+        tcp::resolver resolver;
+        boost::asio::deadline_timer attempt_delay;
+
+        vector<tcp::endpoint> endpoints;
+        size_t next_endpoint;
+        vector<shared_ptr<tcp::socket>> attempts;
+        size_t attempts_in_flight;
+        error_code last_error;
+        bool done;
+};
+
+Tcp::Connector::Connector(std::unique_ptr<Tcp> client_, Connect_Callback_t callback_)
+    : client(std::move(client_)),
+      callback(callback_),
+      strand(client->io_service->create_strand()),
+      resolver(client->io_service->get()),
+      attempt_delay(client->io_service->get()),
+      next_endpoint(0),
+      attempts_in_flight(0),
+      last_error(boost::asio::error::host_not_found),
+      done(false)
+{}
+
+void Tcp::Connector::start(const string& host_, const string& service_)
+{
+    host = host_;
+    service = service_;
+
+    auto self = shared_from_this();
+    Resolver_Cache::Endpoints_t cached;
+    error_code cached_ec;
+    if (Resolver_Cache::get().lookup(host, service, cached, cached_ec))
+    {
+        strand.post([self, cached_ec, cached] ()
+            { self->handle_endpoints(cached_ec, cached); }
+        );
+        return;
+    }
+
+    tcp::resolver::query query(host, service);
+    resolver.async_resolve(query, strand.wrap(
+        [self] (const error_code& ec, tcp::resolver::iterator endpoint_iterator)
+            { self->handle_resolve(ec, endpoint_iterator); }
+    ));
+}
+
+void Tcp::Connector::handle_resolve(const error_code& ec, tcp::resolver::iterator endpoint_iterator)
+{
+    Resolver_Cache::Endpoints_t resolved;
+    if (ec)
+    {
+        Resolver_Cache::get().insert_error(host, service, ec);
+    }
+    else
+    {
+        tcp::resolver::iterator end;
+        resolved.assign(endpoint_iterator, end);
+        Resolver_Cache::get().insert(host, service, resolved);
+    }
+
+    handle_endpoints(ec, resolved);
+}
+
+void Tcp::Connector::handle_endpoints(const error_code& ec, const Resolver_Cache::Endpoints_t& resolved)
+{
+    if (ec)
+    {
+        finish(ec);
+        return;
+    }
+
+    // Interleave address families, starting with the family the resolver preferred, so a
+    // broken family can only delay the connection by one attempt.
+    vector<tcp::endpoint> preferred, other;
+    for (const tcp::endpoint& ep : resolved)
+    {
+        if (preferred.empty() or ep.protocol() == preferred.front().protocol())
+        {
+            preferred.push_back(ep);
+        }
+        else
+        {
+            other.push_back(ep);
+        }
+    }
+
+    for (size_t i = 0; i < std::max(preferred.size(), other.size()); ++i)
+    {
+        if (i < preferred.size())
+        {
+            endpoints.push_back(preferred[i]);
+        }
+        if (i < other.size())
+        {
+            endpoints.push_back(other[i]);
+        }
+    }
+
+    Logger::get()->debug("Tcp: resolved {} endpoints", endpoints.size());
+    start_next_attempt();
+}
+
+void Tcp::Connector::start_next_attempt()
+{
+    if (next_endpoint == endpoints.size())
+    {
+        if (attempts_in_flight == 0)
+        {
+            finish(last_error);
+        }
+        return;
+    }
+
+    auto self = shared_from_this();
+    auto attempt = make_shared<tcp::socket>(client->io_service->get());
+    attempts.push_back(attempt);
+
+    // Buffer sizes must be set before the handshake. If opening fails here async_connect
+    // fails the same way.
+    error_code ec;
+    attempt->open(endpoints[next_endpoint].protocol(), ec);
+    if (!ec)
+    {
+        client->options.apply_before_connect(*attempt, ec);
+        if (ec)
+        {
+            Logger::get()->warn("Tcp: failed to set socket buffer sizes: {}", ec.message());
+        }
+    }
+    ++attempts_in_flight;
+
+    attempt->async_connect(endpoints[next_endpoint++], strand.wrap(
+        [self, attempt] (const error_code& ec)
+            { self->handle_connect(ec, attempt); }
+    ));
+
+    // Setting the expiry cancels the wait of the previous attempt.
+    attempt_delay.expires_from_now(connection_attempt_delay_c);
+    attempt_delay.async_wait(strand.wrap(
+        [self] (const error_code& ec)
+            { self->handle_attempt_delay(ec); }
+    ));
+}
+
+void Tcp::Connector::handle_attempt_delay(const error_code& ec)
+{
+    if (ec or done)
+    {
+        return;
+    }
+
+    Logger::get()->trace("Tcp: connection attempt is slow; racing the next endpoint");
+    start_next_attempt();
+}
+
+void Tcp::Connector::handle_connect(const error_code& ec, shared_ptr<tcp::socket> attempt)
+{
+    --attempts_in_flight;
+
+    if (done)
+    {
+        return;
+    }
+
+    if (ec)
+    {
+        Logger::get()->debug("Tcp: connection attempt failed: {}", ec.message());
+        last_error = ec;
+        start_next_attempt();
+        return;
+    }
+
+    // Cancel the losing attempts.
+    for (auto& other : attempts)
+    {
+        if (other != attempt)
+        {
+            error_code ignored;
+            other->close(ignored);
+        }
+    }
+
+    client->socket = std::move(*attempt);
+    finish(ec);
+}
+
+void Tcp::Connector::finish(const error_code& ec)
+{
+    if (done)
+    {
+        return;
+    }
+    done = true;
+    attempt_delay.cancel();
+
+    if (ec)
+    {
+        // Every endpoint failed so the cached endpoints may be stale.
+        if (!endpoints.empty())
+        {
+            Resolver_Cache::get().invalidate(host, service);
+        }
+
+        Logger::get()->info("TCP connection failed: {}", ec.message());
+        client->connection_status = Status_t::Bad;
+        callback(ec, nullptr);
+        return;
+    }
+
+    client->connection_status = Status_t::Open;
+    client->apply_socket_options();
+    callback(ec, std::move(client));
+}
+
+Tcp::Connect_Return_t Tcp::async_create(const string& host, const string& service,
+                                        shared_ptr<Io_Service_Manager> shared_io_service,
+                                        const Socket_Options& options)
+{
+    auto prom = make_shared<promise<std::unique_ptr<Tcp>>>();
+    async_create(host, service, shared_io_service,
+        [prom] (const error_code& ec, std::unique_ptr<Tcp> client)
+        {
+            if (ec)
+            {
+                prom->set_exception(system_error(ec));
+                return;
+            }
+            prom->set_value(std::move(client));
+        },
+        options
+    );
+    return prom->get_future();
+}
+
+void Tcp::async_create(const string& host, const string& service,
+                       shared_ptr<Io_Service_Manager> shared_io_service,
+                       Connect_Callback_t callback,
+                       const Socket_Options& options)
+{
+    std::unique_ptr<Tcp> client(new Tcp(shared_io_service, options));
+    make_shared<Connector>(std::move(client), callback)->start(host, service);
+}
+
 // Starts connection with the server host
-Tcp::Tcp(const std::string& host, const std::string& service)
-    : io_service(Io_Service_Manager::Behavior_t::Perpetual),
-      socket(io_service.get()),
-      socket_rw_strand(io_service.create_strand()),
-      connection_status(Status_t::Connecting)
+Tcp::Tcp(const std::string& host, const std::string& service, const Socket_Options& options_)
+    : receive_data(Buffer_Pool::get().acquire()),
+      io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual)),
+      owns_service(true),
+      socket(io_service->get()),
+      options(options_),
+      send_strand(io_service->create_strand()),
+      recv_strand(io_service->create_strand()),
+      connection_status(Status_t::Connecting),
+      pending_operations(0),
+      view_owner(make_shared<View_Owner>(this)),
+      view_held(false),
+      receive_in_flight(false),
+      coalescing(false),
+      flush_bytes(0),
+      flush_timer(io_service->get()),
+      pending_send_bytes(0),
+      flush_in_flight(false)
+{
+    connect(host, service);
+}
+
+// Starts connection with the server host on a shared io_service
+Tcp::Tcp(const std::string& host, const std::string& service,
+         shared_ptr<net::Io_Service_Manager> shared_io_service,
+         const Socket_Options& options_)
+    : receive_data(Buffer_Pool::get().acquire()),
+      io_service(shared_io_service),
+      owns_service(false),
+      socket(io_service->get()),
+      options(options_),
+      send_strand(io_service->create_strand()),
+      recv_strand(io_service->create_strand()),
+      connection_status(Status_t::Connecting),
+      pending_operations(0),
+      view_owner(make_shared<View_Owner>(this)),
+      view_held(false),
+      receive_in_flight(false),
+      coalescing(false),
+      flush_bytes(0),
+      flush_timer(io_service->get()),
+      pending_send_bytes(0),
+      flush_in_flight(false)
 {
     connect(host, service);
 }
 
+// Left unconnected for a Connector
+Tcp::Tcp(shared_ptr<net::Io_Service_Manager> shared_io_service, const Socket_Options& options_)
+    : receive_data(Buffer_Pool::get().acquire()),
+      io_service(shared_io_service),
+      owns_service(false),
+      socket(io_service->get()),
+      options(options_),
+      send_strand(io_service->create_strand()),
+      recv_strand(io_service->create_strand()),
+      connection_status(Status_t::Connecting),
+      pending_operations(0),
+      view_owner(make_shared<View_Owner>(this)),
+      view_held(false),
+      receive_in_flight(false),
+      coalescing(false),
+      flush_bytes(0),
+      flush_timer(io_service->get()),
+      pending_send_bytes(0),
+      flush_in_flight(false)
+{}
+
 // Closes the connection if it is still open
 Tcp::~Tcp()
 {
@@ -52,6 +417,15 @@ Tcp::~Tcp()
     {
         close();
     }
+
+    // After closing so the receives queued behind a view fail right away.
+    detach_views();
+
+    // Handlers still queued on a shared service reference this object.
+    if (!owns_service)
+    {
+        wait_for_operations();
+    }
 }
 
 bool Tcp::is_open()
@@ -59,45 +433,79 @@ bool Tcp::is_open()
     return connection_status == Status_t::Open and socket.is_open();
 }
 
-// Stops I/O service operations, closes out the socket, sets state to Closed.
+bool Tcp::is_alive()
+{
+    if (!is_open())
+    {
+        return false;
+    }
+
+    // Data already buffered is handed out before any EOF behind it.
+    if (receive_data->size() > 0)
+    {
+        return true;
+    }
+
+    // asio's synchronous receive would wait for the socket to become readable, so ask the
+    // socket directly. 0 is an orderly shutdown by the peer.
+    char probe;
+    ssize_t peeked = ::recv(socket.native_handle(), &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (peeked > 0)
+    {
+        return true;
+    }
+    if (peeked < 0 and (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR))
+    {
+        return true;
+    }
+
+    Logger::get()->debug("Tcp: peer closed idle connection");
+    return false;
+}
+
+// Stops I/O service operations, closes out the socket, sets state to Closed. A shared
+// io_service keeps running; closing the socket aborts this connection's operations.
 // XXX split this up into close() and disconnect()? maybe somehow distinguish from client and
 //     server disconnects
 void Tcp::close()
 {
-    io_service.stop();
-
-    try
+    // A disconnect seen by a send and a receive closes from both strands at once, so only the
+    // first close touches the socket.
+    if (connection_status.exchange(Status_t::Closed) == Status_t::Closed)
     {
-        // Shutdown before closing for portable graceful closures.
-        socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send);
-        socket.shutdown(boost::asio::ip::tcp::socket::shutdown_receive);
-        socket.close();
+        return;
     }
-    catch(boost::system::system_error e)
+
+    // A disconnect closes the connection from a worker of the private service, which can't
+    // stop it. The service then stops when the connection is destroyed.
+    if (owns_service and io_service->is_running() and !io_service->in_worker_thread())
     {
-        Logger::get()->debug("Tcp::close() {} ", e.what());
+        io_service->stop();
     }
 
-    connection_status = Status_t::Closed;
+    // Shutdown before closing for portable graceful closures. Shutdown fails once the peer is
+    // gone, the socket is closed anyway so queued operations fail instead of reading on.
+    error_code ec;
+    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+    if (!ec)
+    {
+        socket.shutdown(boost::asio::ip::tcp::socket::shutdown_receive, ec);
+    }
+    if (ec)
+    {
+        Logger::get()->debug("Tcp::close() shutdown: {} ", ec.message());
+    }
+    socket.close(ec);
 }
 
 Tcp::Send_Return_t Tcp::send(const const_buffer& data, error_code& ec)
 {
-    auto send_buffer_fn = [this, data] (Send_Callback_t callback)
-    {
-        size_t size = buffer_size(data);
-        async_write(socket, buffer(data, size), callback);
-    };
-    return post_send_to_strand(send_buffer_fn);
+    return post_send_to_strand({ data });
 }
 
 Tcp::Send_Return_t Tcp::send(const vector<const_buffer>& data, error_code& ec)
 {
-    auto send_buffers_fn = [this, data] (Send_Callback_t callback)
-    {
-        async_write(socket, data, callback);
-    };
-    return post_send_to_strand(send_buffers_fn);
+    return post_send_to_strand(data);
 }
 
 Tcp::Send_Return_t Tcp::send(const string& str, error_code& ec)
@@ -113,26 +521,178 @@ Tcp::Send_Return_t Tcp::send(const int number, error_code& ec)
     return send(send_buf, ec);
 }
 
-Tcp::Send_Return_t Tcp::post_send_to_strand(std::function<void(Send_Callback_t)> send_fn)
+void Tcp::send(const const_buffer& data, Send_Handler_t handler)
+{
+    post_send_to_strand({ data }, [this, handler] (const error_code& ec, size_t len)
+        { handle_send(ec, len, handler); }
+    );
+}
+
+void Tcp::send(const vector<const_buffer>& data, Send_Handler_t handler)
+{
+    post_send_to_strand(data, [this, handler] (const error_code& ec, size_t len)
+        { handle_send(ec, len, handler); }
+    );
+}
+
+void Tcp::send(const string& str, Send_Handler_t handler)
+{
+    send(buffer(str), handler);
+}
+
+size_t Tcp::send(const const_buffer& data, yield_context yield)
+{
+    return await_handler<size_t>(yield, [this, &data] (Send_Handler_t handler)
+        { send(data, handler); }
+    );
+}
+
+size_t Tcp::send(const vector<const_buffer>& data, yield_context yield)
+{
+    return await_handler<size_t>(yield, [this, &data] (Send_Handler_t handler)
+        { send(data, handler); }
+    );
+}
+
+size_t Tcp::send(const string& str, yield_context yield)
+{
+    return send(buffer(str), yield);
+}
+
+void Tcp::enable_write_coalescing(size_t flush_bytes_, time_duration flush_delay_)
+{
+    send_strand.post([this, flush_bytes_, flush_delay_] ()
+        {
+            coalescing = true;
+            flush_bytes = flush_bytes_;
+            flush_delay = flush_delay_;
+        }
+    );
+}
+
+void Tcp::disable_write_coalescing()
+{
+    send_strand.post([this] ()
+        {
+            coalescing = false;
+            flush_sends();
+        }
+    );
+}
+
+Tcp::Send_Return_t Tcp::post_send_to_strand(vector<const_buffer> data)
 {
     auto prom = make_shared<promise<size_t>>();
-    auto send_callback = [this, prom] (const error_code& ec, size_t len)
-        { handle_send(ec, len, prom); };
-    // XXX Should send_callback execute in a separate strand allowing a thread to recv
-    // into socket buff and a different thread to read from socket buff to string?
-    socket_rw_strand.post(bind(send_fn, send_callback));
+    post_send_to_strand(std::move(data), [this, prom] (const error_code& ec, size_t len)
+        { handle_send(ec, len, prom); }
+    );
     return prom->get_future();
 }
 
+void Tcp::post_send_to_strand(vector<const_buffer> data, Send_Callback_t on_sent)
+{
+    begin_operation();
+    send_strand.post([this, data, on_sent] () { start_send(data, on_sent); });
+}
+
+void Tcp::start_send(const vector<const_buffer>& data, Send_Callback_t on_sent)
+{
+    // Only one write is in flight at a time. Sends made meanwhile are queued and written
+    // together once it finishes, so they keep their order even once coalescing is disabled.
+    if (!coalescing and !flush_in_flight and pending_sends.empty())
+    {
+        flush_in_flight = true;
+        async_write(socket, data, send_strand.wrap([this, on_sent] (const error_code& ec, size_t len)
+            {
+                on_sent(ec, len);
+                flush_in_flight = false;
+                flush_sends();
+                end_operation();
+            }
+        ));
+        return;
+    }
+
+    size_t size = buffer_size(data);
+    pending_sends.push_back(Pending_Send{ data, size, on_sent });
+    pending_send_bytes += size;
+
+    if (!coalescing or pending_send_bytes >= flush_bytes)
+    {
+        flush_sends();
+    }
+    else if (pending_sends.size() == 1 and !flush_in_flight)
+    {
+        // The wait references this object so it is tracked like any other operation.
+        begin_operation();
+        flush_timer.expires_from_now(flush_delay);
+        flush_timer.async_wait(send_strand.wrap([this] (const error_code& ec)
+            { handle_flush_delay(ec); end_operation(); }
+        ));
+    }
+}
+
+void Tcp::flush_sends()
+{
+    if (flush_in_flight or pending_sends.empty())
+    {
+        return;
+    }
+    flush_in_flight = true;
+    flush_timer.cancel();
+
+    auto batch = make_shared<vector<Pending_Send>>();
+    batch->swap(pending_sends);
+    pending_send_bytes = 0;
+
+    vector<const_buffer> gathered;
+    for (const auto& pending : *batch)
+    {
+        gathered.insert(gathered.end(), pending.data.begin(), pending.data.end());
+    }
+
+    Logger::get()->trace("Tcp: writing {} coalesced sends", batch->size());
+    async_write(socket, gathered, send_strand.wrap(
+        [this, batch] (const error_code& ec, size_t len)
+            { handle_coalesced_send(ec, len, batch); }
+    ));
+}
+
+void Tcp::handle_flush_delay(const error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted)
+    {
+        return;
+    }
+
+    flush_sends();
+}
+
+void Tcp::handle_coalesced_send(const error_code& ec, size_t length,
+                                shared_ptr<vector<Pending_Send>> batch)
+{
+    // Hand every caller its share of the bytes written, in the order they were sent.
+    for (const auto& pending : *batch)
+    {
+        size_t sent = std::min(pending.size, length);
+        length -= sent;
+        pending.on_sent(ec, sent);
+    }
+
+    flush_in_flight = false;
+    flush_sends();
+
+    // Last, since this object may be destroyed once every operation has ended.
+    for (size_t i = 0; i < batch->size(); ++i)
+    {
+        end_operation();
+    }
+}
+
 void Tcp::handle_send(const error_code& ec, size_t length, Send_Prom_t prom)
 {
-    /* XXX Error: this is executed by a io_service worker. When the service worker
-                  calls handle_disconnect() this leads to a io_service_manager_stop()
-                  ((still being run by the worker)) which calls worker_thread->join()
-                  and that will seg fault.
-    // XXX Maybe just set state of TCP to closed and let a non-worker thread deal with it?
-    // XXX Signals? When there's many jobs in the io_service they should all be notified
-            of this disconnect. Somehow the jobs which can no longer execute must be stopped.
+    /* XXX Signals? When there's many jobs in the io_service they should all be notified
+              of this disconnect. Somehow the jobs which can no longer execute must be stopped.
     */
     if (ec)
     {
@@ -142,19 +702,30 @@ void Tcp::handle_send(const error_code& ec, size_t length, Send_Prom_t prom)
         }
         else // XXX add more cases for all error codes
         {
-            prom->set_exception(ec);
+            prom->set_exception(system_error(ec));
+            return;
         }
     }
 
     prom->set_value(length);
 }
 
+void Tcp::handle_send(const error_code& ec, size_t length, const Send_Handler_t& handler)
+{
+    if (ec and is_disconnect_error(ec))
+    {
+        handle_disconnect();
+    }
+
+    handler(ec, length);
+}
+
 // XXX untested
 Tcp::Receive_Return_t Tcp::receive(error_code& ec)
 {
     auto recv_fn = [this] (Receive_Callback_t callback)
     {
-        async_read(socket, receive_data, callback);
+        read_all(callback);
     };
     return post_recv_to_strand(recv_fn);
 }
@@ -163,7 +734,7 @@ Tcp::Receive_Return_t Tcp::receive(size_t size, error_code& ec)
 {
     auto recv_size_fn = [this, size] (Receive_Callback_t callback)
     {
-        async_read(socket, receive_data, transfer_exactly(size), callback);
+        read_size(size, callback);
     };
     return post_recv_to_strand(recv_size_fn);
 }
@@ -172,22 +743,171 @@ Tcp::Receive_Return_t Tcp::receive(std::string pattern, error_code& ec)
 {
     auto recv_pattern_fn = [this, pattern] (Receive_Callback_t callback)
     {
-        async_read_until(socket, receive_data, pattern, callback);
+        async_read_until(socket, *receive_data, pattern, callback);
     };
     return post_recv_to_strand(recv_pattern_fn);
 }
 
+void Tcp::receive(Receive_Handler_t handler)
+{
+    auto recv_fn = [this] (Receive_Callback_t callback)
+    {
+        read_all(callback);
+    };
+    post_recv_to_strand(recv_fn, handler);
+}
+
+void Tcp::receive(size_t size, Receive_Handler_t handler)
+{
+    auto recv_size_fn = [this, size] (Receive_Callback_t callback)
+    {
+        read_size(size, callback);
+    };
+    post_recv_to_strand(recv_size_fn, handler);
+}
+
+void Tcp::receive(std::string pattern, Receive_Handler_t handler)
+{
+    auto recv_pattern_fn = [this, pattern] (Receive_Callback_t callback)
+    {
+        async_read_until(socket, *receive_data, pattern, callback);
+    };
+    post_recv_to_strand(recv_pattern_fn, handler);
+}
+
+shared_ptr<string> Tcp::receive(yield_context yield)
+{
+    return await_handler<shared_ptr<string>>(yield, [this] (Receive_Handler_t handler)
+        { receive(handler); }
+    );
+}
+
+shared_ptr<string> Tcp::receive(size_t size, yield_context yield)
+{
+    return await_handler<shared_ptr<string>>(yield, [this, size] (Receive_Handler_t handler)
+        { receive(size, handler); }
+    );
+}
+
+shared_ptr<string> Tcp::receive(std::string pattern, yield_context yield)
+{
+    return await_handler<shared_ptr<string>>(yield, [this, &pattern] (Receive_Handler_t handler)
+        { receive(pattern, handler); }
+    );
+}
+
 Tcp::Receive_Return_t Tcp::post_recv_to_strand(std::function<void(Receive_Callback_t)> recv_fn)
 {
     auto prom = make_shared<promise<shared_ptr<string>>>();
     auto recv_callback = [this, prom] (const error_code& ec, size_t len)
-        { handle_receive(ec, len, prom); };
-    // XXX Should recv_callback execute in a separate strand allowing a thread to recv into socket buff
-    // and a different thread to read from socket buff to string?
-    socket_rw_strand.post(bind(recv_fn, recv_callback));
+        { handle_receive(ec, len, prom); finish_receive(); end_operation(); };
+    begin_operation();
+    recv_strand.post(bind(&Tcp::start_or_defer_receive, this,
+                               std::function<void()>(bind(recv_fn, recv_callback))));
     return prom->get_future();
 }
 
+void Tcp::post_recv_to_strand(std::function<void(Receive_Callback_t)> recv_fn,
+                              Receive_Handler_t handler)
+{
+    auto recv_callback = [this, handler] (const error_code& ec, size_t len)
+        { handle_receive(ec, len, handler); finish_receive(); end_operation(); };
+    begin_operation();
+    recv_strand.post(bind(&Tcp::start_or_defer_receive, this,
+                               std::function<void()>(bind(recv_fn, recv_callback))));
+}
+
+Tcp::Receive_View_Return_t Tcp::receive_view(size_t size, error_code& ec)
+{
+    auto recv_size_fn = [this, size] (Receive_Callback_t callback)
+    {
+        read_size(size, callback);
+    };
+    return post_recv_view_to_strand(recv_size_fn);
+}
+
+Tcp::Receive_View_Return_t Tcp::receive_view(std::string pattern, error_code& ec)
+{
+    auto recv_pattern_fn = [this, pattern] (Receive_Callback_t callback)
+    {
+        async_read_until(socket, *receive_data, pattern, callback);
+    };
+    return post_recv_view_to_strand(recv_pattern_fn);
+}
+
+Tcp::Receive_View_Return_t Tcp::post_recv_view_to_strand(
+        std::function<void(Receive_Callback_t)> recv_fn)
+{
+    auto prom = make_shared<promise<shared_ptr<const Receive_View>>>();
+    auto recv_callback = [this, prom] (const error_code& ec, size_t len)
+        { handle_receive_view(ec, len, prom); finish_receive(); end_operation(); };
+    begin_operation();
+    recv_strand.post(bind(&Tcp::start_or_defer_receive, this,
+                               std::function<void()>(bind(recv_fn, recv_callback))));
+    return prom->get_future();
+}
+
+void Tcp::read_size(size_t size, Receive_Callback_t callback)
+{
+    // Data left over from an earlier receive until a pattern counts towards size.
+    size_t buffered = receive_data->size();
+    size_t missing = size > buffered ? size - buffered : 0;
+    async_read(socket, *receive_data, transfer_exactly(missing),
+        [callback, size, buffered] (const error_code& ec, size_t len)
+            { callback(ec, ec ? buffered + len : size); }
+    );
+}
+
+void Tcp::read_all(Receive_Callback_t callback)
+{
+    // Data left over from an earlier receive until a pattern is part of the result.
+    size_t buffered = receive_data->size();
+    async_read(socket, *receive_data,
+        [callback, buffered] (const error_code& ec, size_t len)
+            { callback(ec, buffered + len); }
+    );
+}
+
+void Tcp::start_or_defer_receive(std::function<void()> start_fn)
+{
+    {
+        std::lock_guard<std::mutex> lck(receive_lock);
+        if (view_held or receive_in_flight)
+        {
+            deferred_receives.push_back(start_fn);
+            return;
+        }
+        receive_in_flight = true;
+    }
+
+    start_fn();
+}
+
+void Tcp::finish_receive()
+{
+    // Re-armed since the kernel clears it, see Socket_Options::quick_ack.
+    if (options.quick_ack)
+    {
+        error_code ignored;
+        options.apply_quick_ack(socket, ignored);
+    }
+
+    std::function<void()> next;
+    {
+        std::lock_guard<std::mutex> lck(receive_lock);
+        receive_in_flight = false;
+        if (view_held or deferred_receives.empty())
+        {
+            return;
+        }
+        receive_in_flight = true;
+        next = std::move(deferred_receives.front());
+        deferred_receives.pop_front();
+    }
+
+    recv_strand.post(next);
+}
+
 void Tcp::handle_receive(const error_code& ec, size_t length, Receive_Prom_t prom)
 {
     if (ec)
@@ -199,7 +919,8 @@ void Tcp::handle_receive(const error_code& ec, size_t length, Receive_Prom_t pro
         }
         else // XXX add more cases for all error codes
         {
-            prom->set_exception(ec);
+            prom->set_exception(system_error(ec));
+            return;
         }
     }
 
@@ -208,60 +929,214 @@ void Tcp::handle_receive(const error_code& ec, size_t length, Receive_Prom_t pro
     prom->set_value(response);
 }
 
+void Tcp::handle_receive(const error_code& ec, size_t length, const Receive_Handler_t& handler)
+{
+    if (ec and !is_disconnect_error(ec))
+    {
+        handler(ec, nullptr);
+        return;
+    }
+
+    if (ec)
+    {
+        handle_disconnect();
+    }
+
+    handler(ec, consume_receive_data(length));
+}
+
+void Tcp::handle_receive_view(const error_code& ec, size_t length, Receive_View_Prom_t prom)
+{
+    if (ec)
+    {
+        if (is_disconnect_error(ec))
+        {
+            handle_disconnect();
+        }
+        else // XXX add more cases for all error codes
+        {
+            prom->set_exception(system_error(ec));
+            return;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lck(receive_lock);
+        view_held = true;
+    }
+
+    // The view is consumed when the caller releases it instead of being copied out here.
+    auto view = new Receive_View(view_owner, receive_data, buffer(receive_data->data(), length));
+    prom->set_value(shared_ptr<const Receive_View>(view));
+}
+
+void Tcp::release_view(size_t length)
+{
+    std::function<void()> next;
+    {
+        std::lock_guard<std::mutex> lck(receive_lock);
+        receive_data->consume(length);
+        view_held = false;
+
+        // The receive that returned the view may not have finished yet, if so it starts the
+        // next one instead.
+        if (receive_in_flight or deferred_receives.empty())
+        {
+            return;
+        }
+        receive_in_flight = true;
+        next = std::move(deferred_receives.front());
+        deferred_receives.pop_front();
+    }
+
+    recv_strand.post(next);
+}
+
+void Tcp::detach_views()
+{
+    {
+        std::lock_guard<std::mutex> lck(view_owner->lock);
+        view_owner->tcp = nullptr;
+    }
+
+    std::function<void()> next;
+    {
+        std::lock_guard<std::mutex> lck(receive_lock);
+        if (!view_held)
+        {
+            return;
+        }
+
+        // The view keeps the old buffer so its data stays valid.
+        receive_data = Buffer_Pool::get().acquire();
+        view_held = false;
+        if (receive_in_flight or deferred_receives.empty())
+        {
+            return;
+        }
+        receive_in_flight = true;
+        next = std::move(deferred_receives.front());
+        deferred_receives.pop_front();
+    }
+
+    recv_strand.post(next);
+}
+
+Tcp::Receive_View::~Receive_View()
+{
+    std::lock_guard<std::mutex> lck(owner->lock);
+    if (owner->tcp)
+    {
+        owner->tcp->release_view(size());
+    }
+}
+
 shared_ptr<string> Tcp::consume_receive_data(size_t length)
 {
-    Logger::get()->trace("Tcp::handle_receive pre-read buffer size: {}", receive_data.size());
+    Logger::get()->trace("Tcp::handle_receive pre-read buffer size: {}", receive_data->size());
 
     auto res = make_shared<string>();
     res->reserve(length);
 
     // Retrieve socket input buffers and copy data into the return string.
     // Once copy is done remove the data from the socket buffer.
-    auto recv_bufs = receive_data.data();
+    auto recv_bufs = receive_data->data();
     std::copy(boost::asio::buffers_begin(recv_bufs),
               boost::asio::buffers_begin(recv_bufs) + length,
               std::back_inserter(*res));
-    receive_data.consume(length);
+    receive_data->consume(length);
 
-    Logger::get()->trace("Tcp::handle_receive post-read buffer size: {}", receive_data.size());
+    Logger::get()->trace("Tcp::handle_receive post-read buffer size: {}", receive_data->size());
 
     return res;
 }
 
+// XXX blocking; see async_create()
 void Tcp::connect(const string& host, const string& service)
 {
-    // XXX use async_connect?
-
     // Get a list of endpoints corresponding to the server name.
-    boost::asio::ip::tcp::resolver resolver(io_service.get());
-    boost::asio::ip::tcp::resolver::query query(host, service);
-    auto endpoint_iterator = resolver.resolve(query);
+    error_code error;
+    auto endpoints = Resolver_Cache::get().resolve(io_service->get(), host, service, error);
+    if (error)
+    {
+        connection_status = Status_t::Bad;
+        throw system_error(error);
+    }
 
-    // Try each endpoint until we successfully establish a connection.
-    boost::asio::ip::tcp::resolver::iterator end;
-    error_code error = boost::asio::error::host_not_found;
-    while (error and endpoint_iterator != end)
+    // Try each endpoint until we successfully establish a connection. Buffer sizes must be
+    // set before the handshake.
+    error = boost::asio::error::host_not_found;
+    for (auto it = endpoints.begin(); error and it != endpoints.end(); ++it)
     {
         socket.close();
-        socket.connect(*endpoint_iterator++, error);
+        socket.open(it->protocol(), error);
+        if (error)
+        {
+            continue;
+        }
+
+        error_code options_ec;
+        options.apply_before_connect(socket, options_ec);
+        if (options_ec)
+        {
+            Logger::get()->warn("Tcp: failed to set socket buffer sizes: {}", options_ec.message());
+        }
+        socket.connect(*it, error);
     }
 
     if (error)
     {
+        // The cached endpoints may be stale.
+        Resolver_Cache::get().invalidate(host, service);
+
         Logger::get()->info("TCP connection failed: {}", error.message());
         connection_status = Status_t::Bad;
         throw system_error(error);
     }
 
     connection_status = Status_t::Open;
+    apply_socket_options();
+}
+
+void Tcp::apply_socket_options()
+{
+    error_code ec;
+    options.apply(socket, ec);
+    if (ec)
+    {
+        Logger::get()->warn("Tcp: failed to set socket options: {}", ec.message());
+    }
 }
 
 bool Tcp::is_disconnect_error(const error_code& ec)
 {
-    return (boost::asio::error::eof == ec) or (boost::asio::error::connection_reset == ec);
+    // A send reports a reset the receive already consumed as a broken pipe.
+    return (boost::asio::error::eof == ec) or (boost::asio::error::connection_reset == ec)
+        or (boost::asio::error::broken_pipe == ec);
 }
 
 void Tcp::handle_disconnect()
 {
     close();
 }
+
+void Tcp::begin_operation()
+{
+    std::lock_guard<std::mutex> lck(pending_operations_lock);
+    ++pending_operations;
+}
+
+void Tcp::end_operation()
+{
+    std::lock_guard<std::mutex> lck(pending_operations_lock);
+    if (--pending_operations == 0)
+    {
+        operations_done_cv.notify_all();
+    }
+}
+
+void Tcp::wait_for_operations()
+{
+    std::unique_lock<std::mutex> lck(pending_operations_lock);
+    operations_done_cv.wait(lck, [this] () { return pending_operations == 0; });
+}
@@ -0,0 +1,116 @@
+#include "tcp_pipeline.h"
+
+#include "logger.h"
+
+#include <string>
+
+#include "boost_config.h"
+
+using boost::asio::buffer;
+using boost::asio::const_buffer;
+using boost::promise;
+using boost::system::error_code;
+using boost::system::system_error;
+
+using net::Io_Service_Manager;
+using net::Tcp;
+using net::Tcp_Pipeline;
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+
+Tcp_Pipeline::Tcp_Pipeline(unique_ptr<Tcp> client_)
+  : outstanding_requests(0),
+    client(std::move(client_))
+{}
+
+Tcp_Pipeline::Tcp_Pipeline(const string& host, const string& service)
+  : outstanding_requests(0),
+    client(new Tcp(host, service))
+{}
+
+Tcp_Pipeline::Tcp_Pipeline(const string& host, const string& service,
+                           shared_ptr<Io_Service_Manager> shared_io_service)
+  : outstanding_requests(0),
+    client(new Tcp(host, service, shared_io_service))
+{}
+
+Tcp_Pipeline::Response_Return_t Tcp_Pipeline::request(const const_buffer& data, string delimiter)
+{
+    return pipeline(data, [this, delimiter] (Tcp::Receive_Handler_t handler)
+        { client->receive(delimiter, handler); }
+    );
+}
+
+Tcp_Pipeline::Response_Return_t Tcp_Pipeline::request(const string& data, string delimiter)
+{
+    return request(buffer(data), delimiter);
+}
+
+Tcp_Pipeline::Response_Return_t Tcp_Pipeline::request(const const_buffer& data,
+                                                      size_t response_size)
+{
+    return pipeline(data, [this, response_size] (Tcp::Receive_Handler_t handler)
+        { client->receive(response_size, handler); }
+    );
+}
+
+Tcp_Pipeline::Response_Return_t Tcp_Pipeline::request(const string& data, size_t response_size)
+{
+    return request(buffer(data), response_size);
+}
+
+Tcp_Pipeline::Response_Return_t Tcp_Pipeline::pipeline(
+        const const_buffer& data,
+        std::function<void(Tcp::Receive_Handler_t)> receive_fn)
+{
+    auto request = make_shared<Pending_Request>();
+    request->settled = false;
+    auto response = request->prom.get_future();
+
+    ++outstanding_requests;
+
+    // A failed send fails the request right away. Its receive still runs, and fails too
+    // unless the peer answers anyway, so the responses behind it stay in order.
+    auto on_sent = [this, request] (const error_code& ec, size_t)
+    {
+        if (ec)
+        {
+            fail(*request, ec);
+        }
+    };
+
+    auto on_response = [this, request] (const error_code& ec, shared_ptr<string> data)
+    {
+        --outstanding_requests;
+        if (ec)
+        {
+            fail(*request, ec);
+        }
+        else if (!request->settled.exchange(true))
+        {
+            request->prom.set_value(data);
+        }
+    };
+
+    // Tcp runs sends and receives in the order they were made, so issuing both under the
+    // lock keeps this request's response matched to it.
+    {
+        std::lock_guard<std::mutex> lck(order_lock);
+        client->send(data, on_sent);
+        receive_fn(on_response);
+    }
+
+    return response;
+}
+
+void Tcp_Pipeline::fail(Pending_Request& request, const error_code& ec)
+{
+    if (!request.settled.exchange(true))
+    {
+        Logger::get()->debug("Tcp_Pipeline: request failed {}", ec.message());
+        request.prom.set_exception(system_error(ec));
+    }
+}
@@ -1,18 +1,30 @@
 #include "tcp_pool.h"
 
 #include "logger.h"
+#include "tcp_pool_manager.h"
 
+#include <algorithm>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "boost_config.h"
-#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
+using boost::future;
+using boost::promise;
 using boost::asio::deadline_timer;
+using boost::posix_time::ptime;
 using boost::posix_time::time_duration;
 using boost::system::error_code;
+using boost::system::system_error;
 
+using net::Io_Service_Manager;
 using net::Tcp;
 using net::Tcp_Pool;
+using net::Tcp_Pool_Manager;
+using net::Timer_Wheel;
 
 using std::lock_guard;
 using std::make_shared;
@@ -22,109 +34,710 @@ using std::mutex;
 using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
+using std::vector;
 using std::weak_ptr;
 
+// Idle connections are expired by a timer wheel ticking this many times per pool timeout.
+static const int idle_ticks_per_timeout_c = 16;
+
 shared_ptr<Tcp_Pool> Tcp_Pool::create(const string& host,
                                       const string& service,
-                                      time_duration duration)
+                                      time_duration duration,
+                                      const Socket_Options& options)
 {
-    return shared_ptr<Tcp_Pool>( new Tcp_Pool(host, service, duration) );
+    return shared_ptr<Tcp_Pool>( new Tcp_Pool(host, service, duration, nullptr, {},
+                                              options) );
 }
 
+shared_ptr<Tcp_Pool> Tcp_Pool::create(const string& host,
+                                      const string& service,
+                                      time_duration duration,
+                                      shared_ptr<Io_Service_Manager> shared_io_service,
+                                      const Socket_Options& options)
+{
+    return shared_ptr<Tcp_Pool>( new Tcp_Pool(host, service, duration, shared_io_service,
+                                              {}, options) );
+}
+
+// Cached connections and their timers are destroyed before io_service_manager.
+// Callers still waiting for a connection are failed.
 Tcp_Pool::~Tcp_Pool()
 {
+    // The wheel may be shared with other pools.
+    if (sweep_armed)
+    {
+        idle_timers->cancel(sweep_timer);
+    }
+    for (auto& shard : idle_shards)
+    {
+        for (auto& idle : shard->connections)
+        {
+            idle_timers->cancel(idle.idle_timer);
+        }
+    }
+
+    for (auto& waiter : waiters)
+    {
+        waiter.handler(boost::asio::error::operation_aborted,
+                       Tcp_Guard(nullptr, weak_ptr<Tcp_Pool>()));
+    }
 }
 
 // Either create a new connection to return or grab a connection from the pool,
-// stop its timer, and return.
-//
-// XXX should there be a 'max connections' where once reached get() will block
-// until a connection is put back in the pool?
+// stop its timer, and return. At the cap this waits for a connection instead.
 Tcp_Pool::Tcp_Guard Tcp_Pool::get()
 {
-    // lock_guard<mutex> lck(connections_lock);
+    weak_ptr<Tcp_Pool> wp(shared_from_this());
 
-    unique_ptr<Tcp> client;
+    size_t discarded = 0;
+    unique_ptr<Tcp> client = take_cached_connection(discarded);
+    release_connection_slots(discarded);
+    if (client)
+    {
+        keep_min_idle();
+        return Tcp_Guard(move(client), wp);
+    }
+
+    std::unique_lock<mutex> lck(waiters_lock);
+    if (!reserve_connection_slot())
+    {
+        lck.unlock();
+        Logger::get()->debug("Tcp_Pool: at max connections; waiting for a connection");
+        return async_get().get();
+    }
 
     // If there are no connections in the pool create a new one.
-    if (connections.empty())
+    lck.unlock();
+
+    Logger::get()->debug("Tcp_Pool: creating new connection for the pool");
+    try
     {
-        Logger::get()->debug("Tcp_Pool: creating new connection for the pool");
-        client = make_unique<Tcp>(host, service);
+        client = new_connection();
     }
-    // Else grab a connection from the pool.
-    else
+    catch (...)
     {
-        Logger::get()->debug("Tcp_Pool: using cached connection");
+        release_connection_slot();
+        throw;
+    }
 
-        // Grab the top connection.
-        Timed_Tcp_Connection_t ttc = std::move(connections.front());
-        connections.pop();
+    keep_min_idle();
+    return Tcp_Guard(move(client), wp);
+}
 
-        // Stop its deadline timer.
-        ttc.second->cancel();
+future<Tcp_Pool::Tcp_Guard> Tcp_Pool::async_get()
+{
+    return async_get(boost::posix_time::pos_infin);
+}
 
-        client = move(ttc.first);
-    }
+future<Tcp_Pool::Tcp_Guard> Tcp_Pool::async_get(time_duration acquire_timeout)
+{
+    auto prom = make_shared<promise<Tcp_Guard>>();
+    async_get(acquire_timeout, [prom] (const error_code& ec, Tcp_Guard tcp_guard)
+        {
+            if (ec)
+            {
+                prom->set_exception(system_error(ec));
+                return;
+            }
+            prom->set_value(move(tcp_guard));
+        }
+    );
+    return prom->get_future();
+}
+
+void Tcp_Pool::async_get(Get_Handler_t handler)
+{
+    async_get(boost::posix_time::pos_infin, handler);
+}
 
+void Tcp_Pool::async_get(time_duration acquire_timeout, Get_Handler_t handler)
+{
     weak_ptr<Tcp_Pool> wp(shared_from_this());
-    Tcp_Guard tcp_guard(move(client), wp);
-    return tcp_guard;
+
+    size_t discarded = 0;
+    unique_ptr<Tcp> client = take_cached_connection(discarded);
+    release_connection_slots(discarded);
+    if (client)
+    {
+        keep_min_idle();
+        handler(error_code(), Tcp_Guard(move(client), wp));
+        return;
+    }
+
+    std::unique_lock<mutex> lck(waiters_lock);
+    if (reserve_connection_slot())
+    {
+        lck.unlock();
+        async_new_connection(handler);
+        keep_min_idle();
+        return;
+    }
+
+    Logger::get()->debug("Tcp_Pool: at max connections; queueing caller");
+    Waiter waiter { next_waiter_id++, handler, nullptr };
+    if (!acquire_timeout.is_special())
+    {
+        uint64_t id = waiter.id;
+        waiter.acquire_timer = make_shared<deadline_timer>(io_service_manager->get());
+        waiter.acquire_timer->expires_from_now(acquire_timeout);
+        waiter.acquire_timer->async_wait([wp, id] (const error_code& ec)
+            {
+                if (auto sp = wp.lock())
+                {
+                    sp->handle_acquire_timeout(ec, id);
+                }
+            }
+        );
+    }
+    waiters.push_back(move(waiter));
+    ++waiter_count;
+    lck.unlock();
+
+    // A connection cached after the shards were checked above, but before waiter_count was
+    // raised, would otherwise sit idle while this caller waits. Likewise a slot the manager
+    // freed in that window was offered before this caller was counted as waiting.
+    serve_waiters();
+    if (waiter_count > 0)
+    {
+        open_slot_for_waiter();
+    }
+}
+
+void Tcp_Pool::set_max_connections(size_t max_connections_)
+{
+    lock_guard<mutex> lck(waiters_lock);
+    max_connections = max_connections_;
+}
+
+void Tcp_Pool::set_reuse_policy(Reuse_Policy_t reuse_policy_)
+{
+    reuse_policy = reuse_policy_;
+}
+
+void Tcp_Pool::set_min_idle(size_t min_idle_)
+{
+    min_idle = min_idle_;
+    replenish();
+}
+
+void Tcp_Pool::set_sweep_interval(time_duration interval)
+{
+    lock_guard<mutex> lck(sweep_lock);
+    if (sweep_armed)
+    {
+        idle_timers->cancel(sweep_timer);
+        sweep_armed = false;
+    }
+
+    sweep_interval = interval;
+    arm_sweep();
+}
+
+size_t Tcp_Pool::idle_count()
+{
+    return idle_connections;
+}
+
+size_t Tcp_Pool::open_count()
+{
+    lock_guard<mutex> lck(waiters_lock);
+    return open_connections;
 }
 
-Tcp_Pool::Tcp_Pool(const string& host_, const string& service_, time_duration duration_)
-  : host(host_),
+// A null shared_io_service_ gives the pool its own perpetual io_service.
+Tcp_Pool::Tcp_Pool(const string& host_, const string& service_, time_duration duration_,
+                   shared_ptr<Io_Service_Manager> shared_io_service_,
+                   weak_ptr<Tcp_Pool_Manager> manager_,
+                   const Socket_Options& options)
+  : io_service_manager(shared_io_service_ ? shared_io_service_ :
+                       make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual)),
+    shared_io_service(shared_io_service_ != nullptr),
+    idle_timers(Timer_Wheel::shared(io_service_manager, idle_timer_tick(duration_))),
+    reuse_policy(Reuse_Policy_t::Fifo),
+    min_idle(0),
+    idle_connections(0),
+    warming_connections(0),
+    sweep_interval(0, 0, 0),
+    sweep_timer(0),
+    sweep_armed(false),
+    manager(manager_),
+    max_connections(0),
+    open_connections(0),
+    waiter_count(0),
+    next_waiter_id(0),
+    host(host_),
     service(service_),
     timeout(duration_),
-    io_service_manager(Io_Service_Manager::Behavior_t::Perpetual)
+    socket_options(options)
 {
+    unsigned num_shards = std::max(1u, boost::thread::hardware_concurrency());
+    for (unsigned i = 0; i < num_shards; ++i)
+    {
+        idle_shards.push_back(make_unique<Idle_Shard>());
+    }
+}
+
+unique_ptr<Tcp> Tcp_Pool::new_connection()
+{
+    if (shared_io_service)
+    {
+        return make_unique<Tcp>(host, service, io_service_manager, socket_options);
+    }
+
+    return make_unique<Tcp>(host, service, socket_options);
+}
+
+void Tcp_Pool::async_new_connection(Get_Handler_t handler)
+{
+    Logger::get()->debug("Tcp_Pool: asynchronously creating new connection for the pool");
+    weak_ptr<Tcp_Pool> wp(shared_from_this());
+    Tcp::async_create(host, service, io_service_manager,
+        [wp, handler] (const error_code& ec, unique_ptr<Tcp> new_client)
+        {
+            if (ec)
+            {
+                if (auto sp = wp.lock())
+                {
+                    sp->release_connection_slot();
+                }
+                handler(ec, Tcp_Guard(nullptr, wp));
+                return;
+            }
+            handler(ec, Tcp_Guard(move(new_client), wp));
+        },
+        socket_options
+    );
+}
+
+size_t Tcp_Pool::home_shard()
+{
+    static thread_local size_t thread_hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return thread_hash % idle_shards.size();
+}
+
+unique_ptr<Tcp> Tcp_Pool::take_cached_connection(size_t& discarded)
+{
+    // Start at the calling thread's shard and steal from the others when it's empty.
+    size_t home = home_shard();
+    bool lifo = reuse_policy == Reuse_Policy_t::Lifo;
+    for (size_t i = 0; i < idle_shards.size(); ++i)
+    {
+        Idle_Shard& shard = *idle_shards[(home + i) % idle_shards.size()];
+        std::unique_lock<mutex> lck(shard.lock);
+        while (!shard.connections.empty())
+        {
+            // Grab the oldest connection, or the youngest under Lifo. Either way the front
+            // stays the oldest so expiring connections are still found there.
+            Idle_Connection idle;
+            if (lifo)
+            {
+                idle = std::move(shard.connections.back());
+                shard.connections.pop_back();
+            }
+            else
+            {
+                idle = std::move(shard.connections.front());
+                shard.connections.pop_front();
+            }
+            --idle_connections;
+            lck.unlock();
+
+            // Stop its idle timer.
+            idle_timers->cancel(idle.idle_timer);
+
+            if (idle.tcp_client->is_alive())
+            {
+                Logger::get()->debug("Tcp_Pool: using cached connection");
+                return move(idle.tcp_client);
+            }
+
+            // The peer closed it while it was idle. Try the next one.
+            idle.tcp_client.reset();
+            ++discarded;
+            lck.lock();
+        }
+    }
+
+    return nullptr;
+}
+
+void Tcp_Pool::release_connection_slots(size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        release_connection_slot();
+    }
+}
+
+void Tcp_Pool::sweep(Timer_Wheel::Timer_Id_t fired_timer)
+{
+    size_t discarded = 0;
+    for (auto& shard : idle_shards)
+    {
+        std::vector<unique_ptr<Tcp>> dead;
+        {
+            lock_guard<mutex> lck(shard->lock);
+            auto& connections = shard->connections;
+            for (auto it = connections.begin(); it != connections.end(); )
+            {
+                if (it->tcp_client->is_alive())
+                {
+                    ++it;
+                    continue;
+                }
+
+                idle_timers->cancel(it->idle_timer);
+                dead.push_back(move(it->tcp_client));
+                it = connections.erase(it);
+                --idle_connections;
+            }
+        }
+        discarded += dead.size();
+    }
+
+    if (discarded > 0)
+    {
+        Logger::get()->debug("Tcp_Pool: swept {} dead connections", discarded);
+        release_connection_slots(discarded);
+        keep_min_idle();
+    }
+
+    // Not rearmed if the interval was changed while sweeping.
+    lock_guard<mutex> lck(sweep_lock);
+    if (sweep_armed and sweep_timer == fired_timer)
+    {
+        arm_sweep();
+    }
+}
+
+void Tcp_Pool::arm_sweep()
+{
+    if (sweep_interval <= time_duration(0, 0, 0))
+    {
+        sweep_armed = false;
+        return;
+    }
+
+    weak_ptr<Tcp_Pool> wp(shared_from_this());
+    sweep_timer = idle_timers->arm(sweep_interval,
+        [wp] (Timer_Wheel::Timer_Id_t id)
+        {
+            if (auto sp = wp.lock())
+            {
+                sp->sweep(id);
+            }
+        }
+    );
+    sweep_armed = true;
+}
+
+bool Tcp_Pool::reserve_connection_slot()
+{
+    if (max_connections != 0 and open_connections >= max_connections)
+    {
+        return false;
+    }
+
+    auto owner = manager.lock();
+    if (owner and !owner->reserve_connection())
+    {
+        return false;
+    }
+
+    ++open_connections;
+    return true;
 }
 
 void Tcp_Pool::put_connection(std::unique_ptr<Tcp> tcp_client)
 {
-    lock_guard<mutex> lck(connections_lock);
     Logger::get()->trace("Tcp_Pool::put_connection()");
+    size_t shard = home_shard();
 
-    // Create and start the deadline timer.
-    auto deadline = make_shared<deadline_timer>(io_service_manager.get());
-    deadline->expires_from_now(timeout);
-    deadline->async_wait(boost::bind(&Tcp_Pool::handle_remove_connection, this, boost::asio::placeholders::error));
-    Timed_Tcp_Connection_t ttc { move(tcp_client), std::move(deadline) };
+    // Add the connection back to its shard and start its idle timer. The shard stays locked
+    // so the timer can't fire before the connection is cached.
+    {
+        Idle_Shard& idle_shard = *idle_shards[shard];
+        lock_guard<mutex> lck(idle_shard.lock);
+        auto idle_timer = arm_idle_timer(shard);
+        idle_shard.connections.push_back(
+            Idle_Connection { move(tcp_client), idle_timer, deadline_timer::traits_type::now() });
+        ++idle_connections;
+    }
 
-    // Add timed connection back to queue.
-    connections.push(std::move(ttc));
+    // Checked after caching, see async_get().
+    if (waiter_count > 0)
+    {
+        serve_waiters();
+    }
+
+    // Callers waiting on the manager's budget, possibly for another host, need the slot more
+    // than this pool needs an idle connection.
+    auto owner = manager.lock();
+    if (owner and owner->starved())
+    {
+        if (auto evicted = evict_oldest_idle())
+        {
+            evicted.reset();
+            owner->release_connection();
+        }
+    }
 }
 
-void Tcp_Pool::handle_remove_connection(const error_code& ec)
+Timer_Wheel::Timer_Id_t Tcp_Pool::arm_idle_timer(size_t shard)
 {
-    // If there's an error immediately return because deadline.cancel() was called somewhere.
+    // The handler only holds a weak reference since it may run while the pool is being
+    // destroyed.
+    weak_ptr<Tcp_Pool> wp(shared_from_this());
+    return idle_timers->arm(timeout,
+        [wp, shard] (Timer_Wheel::Timer_Id_t id)
+        {
+            if (auto sp = wp.lock())
+            {
+                sp->remove_connection(shard, id);
+            }
+        }
+    );
+}
+
+void Tcp_Pool::replenish()
+{
+    weak_ptr<Tcp_Pool> wp(shared_from_this());
+    while (true)
+    {
+        // Claim one of the missing connections. Other threads may be replenishing too.
+        size_t warming = warming_connections;
+        if (idle_connections + warming >= min_idle)
+        {
+            return;
+        }
+        if (!warming_connections.compare_exchange_weak(warming, warming + 1))
+        {
+            continue;
+        }
+
+        {
+            std::unique_lock<mutex> lck(waiters_lock);
+            if (!reserve_connection_slot())
+            {
+                --warming_connections;
+                return;
+            }
+        }
+
+        Logger::get()->debug("Tcp_Pool: warming a connection");
+        Tcp::async_create(host, service, io_service_manager,
+            [wp] (const error_code& ec, unique_ptr<Tcp> new_client)
+            {
+                auto sp = wp.lock();
+                if (!sp)
+                {
+                    return;
+                }
+
+                if (ec)
+                {
+                    // Not retried until the next get() so an unreachable host isn't hammered.
+                    Logger::get()->debug("Tcp_Pool: warming failed: {}", ec.message());
+                    --sp->warming_connections;
+                    sp->release_connection_slot();
+                    return;
+                }
+
+                // Cached before it stops counting as warming so nobody opens a replacement.
+                sp->put_connection(move(new_client));
+                --sp->warming_connections;
+            },
+            socket_options
+        );
+    }
+}
+
+void Tcp_Pool::serve_waiters()
+{
+    weak_ptr<Tcp_Pool> wp(shared_from_this());
+    while (waiter_count > 0)
+    {
+        std::unique_lock<mutex> lck(waiters_lock);
+        if (waiters.empty())
+        {
+            return;
+        }
+
+        size_t discarded = 0;
+        unique_ptr<Tcp> client = take_cached_connection(discarded);
+        if (!client)
+        {
+            lck.unlock();
+            release_connection_slots(discarded);
+            return;
+        }
+
+        // Hand the connection to the longest waiting caller.
+        Waiter waiter = move(waiters.front());
+        waiters.pop_front();
+        --waiter_count;
+        lck.unlock();
+        release_connection_slots(discarded);
+
+        if (waiter.acquire_timer)
+        {
+            waiter.acquire_timer->cancel();
+        }
+        waiter.handler(error_code(), Tcp_Guard(move(client), wp));
+    }
+}
+
+void Tcp_Pool::release_connection_slot()
+{
+    --open_connections;
+
+    // The manager's budget is shared so the slot may go to a caller waiting on another host.
+    if (auto owner = manager.lock())
+    {
+        owner->release_connection();
+        return;
+    }
+
+    open_slot_for_waiter();
+}
+
+bool Tcp_Pool::open_slot_for_waiter()
+{
+    std::unique_lock<mutex> lck(waiters_lock);
+    if (waiters.empty() or !reserve_connection_slot())
+    {
+        return false;
+    }
+
+    // The freed slot goes to the longest waiting caller.
+    Waiter waiter = move(waiters.front());
+    waiters.pop_front();
+    --waiter_count;
+    lck.unlock();
+
+    if (waiter.acquire_timer)
+    {
+        waiter.acquire_timer->cancel();
+    }
+    async_new_connection(waiter.handler);
+    return true;
+}
+
+Tcp_Pool::Idle_Shard* Tcp_Pool::shard_with_oldest_idle(ptime& idle_since)
+{
+    Idle_Shard* oldest_shard = nullptr;
+    idle_since = ptime(boost::posix_time::not_a_date_time);
+    for (auto& shard : idle_shards)
+    {
+        lock_guard<mutex> lck(shard->lock);
+        if (!shard->connections.empty() and
+            (!oldest_shard or shard->connections.front().idle_since < idle_since))
+        {
+            idle_since = shard->connections.front().idle_since;
+            oldest_shard = shard.get();
+        }
+    }
+    return oldest_shard;
+}
+
+ptime Tcp_Pool::oldest_idle_since()
+{
+    ptime idle_since;
+    shard_with_oldest_idle(idle_since);
+    return idle_since;
+}
+
+unique_ptr<Tcp> Tcp_Pool::evict_oldest_idle()
+{
+    // The shard's front may have been taken, or replaced, since it was found.
+    ptime idle_since;
+    Idle_Shard* oldest_shard = shard_with_oldest_idle(idle_since);
+    if (!oldest_shard)
+    {
+        return nullptr;
+    }
+
+    std::unique_lock<mutex> lck(oldest_shard->lock);
+    if (oldest_shard->connections.empty())
+    {
+        return nullptr;
+    }
+
+    Idle_Connection idle = std::move(oldest_shard->connections.front());
+    oldest_shard->connections.pop_front();
+    --idle_connections;
+    lck.unlock();
+
+    Logger::get()->debug("Tcp_Pool: evicting idle connection");
+    idle_timers->cancel(idle.idle_timer);
+    --open_connections;
+
+    return move(idle.tcp_client);
+}
+
+time_duration Tcp_Pool::idle_timer_tick(time_duration timeout)
+{
+    time_duration min_tick = boost::posix_time::milliseconds(1);
+    return std::max(timeout / idle_ticks_per_timeout_c, min_tick);
+}
+
+void Tcp_Pool::handle_acquire_timeout(const error_code& ec, uint64_t waiter_id)
+{
+    // Cancelled once the waiter was given a connection.
     if (ec)
     {
-        Logger::get()->debug("Tcp_Pool::handle_remove_connection {}", ec.message());
         return;
     }
-    else
+
+    std::unique_lock<mutex> lck(waiters_lock);
+    auto it = std::find_if(waiters.begin(), waiters.end(),
+                           [waiter_id] (const Waiter& w) { return w.id == waiter_id; });
+    if (it == waiters.end())
     {
-        remove_connection();
+        return;
     }
+
+    Get_Handler_t handler = move(it->handler);
+    waiters.erase(it);
+    --waiter_count;
+    lck.unlock();
+
+    Logger::get()->debug("Tcp_Pool: timed out waiting for a connection");
+    handler(boost::asio::error::timed_out, Tcp_Guard(nullptr, shared_from_this()));
 }
 
-void Tcp_Pool::remove_connection()
+void Tcp_Pool::remove_connection(size_t shard, Timer_Wheel::Timer_Id_t expired_timer)
 {
-    lock_guard<mutex> lck(connections_lock);
+    std::unique_lock<mutex> lck(idle_shards[shard]->lock);
     Logger::get()->trace("Tcp_Pool::remove_connection()");
 
-    // Check timer of top connection to see if it's expired
-    auto ttc_ref = &connections.front();
-    if (ttc_ref->second->expires_at() <= deadline_timer::traits_type::now())
+    // The connection may already have been taken if the timer fired just before it was
+    // cancelled. Expiring connections are normally the oldest, at the front.
+    auto& connections = idle_shards[shard]->connections;
+    auto it = std::find_if(connections.begin(), connections.end(),
+                           [expired_timer] (const Idle_Connection& idle)
+                           { return idle.idle_timer == expired_timer; });
+    if (it == connections.end())
     {
-        // Remove connection from queue. This closes and destroys the connection.
-        connections.pop();
+        Logger::get()->debug("Tcp_Pool: expired connection was already taken");
+        return;
     }
-    else
+
+    // Connections at the idle floor are kept rather than closed and opened again.
+    if (idle_connections <= min_idle)
     {
-        Logger::get()->warn("Tcp_Pool: remove_connection() triggered but no connection is expired");
+        it->idle_timer = arm_idle_timer(shard);
+        return;
     }
+
+    // Remove connection from the shard. This closes and destroys the connection.
+    unique_ptr<Tcp> expired = move(it->tcp_client);
+    connections.erase(it);
+    --idle_connections;
+    lck.unlock();
+
+    expired.reset();
+    release_connection_slot();
 }
 
 Tcp_Pool::Tcp_Guard::Tcp_Guard(std::unique_ptr<Tcp>&& tcp_client_,
@@ -137,6 +750,12 @@ Tcp_Pool::Tcp_Guard::Tcp_Guard(std::unique_ptr<Tcp>&& tcp_client_,
 // it will be put back. Otherwise it will be disconnected during destruction.
 Tcp_Pool::Tcp_Guard::~Tcp_Guard()
 {
+    // Moved-from guards protect nothing.
+    if (!tcp_client)
+    {
+        return;
+    }
+
     auto sp = tcp_client_owner.lock();
     // XXX if (sp and tcp_client->status() == Tcp::Status_t::Open)
     if (sp and tcp_client->is_open())
@@ -148,6 +767,10 @@ Tcp_Pool::Tcp_Guard::~Tcp_Guard()
 
     // Not putting connection back, so just close it.
     tcp_client.reset();
+    if (sp)
+    {
+        sp->release_connection_slot();
+    }
 
     if(!sp)
     {
@@ -0,0 +1,179 @@
+#include "tcp_pool_manager.h"
+
+#include "logger.h"
+
+#include <algorithm>
+#include <string>
+
+#include "boost_config.h"
+#include <boost/thread.hpp>
+
+using boost::future;
+using boost::posix_time::ptime;
+using boost::posix_time::time_duration;
+
+using net::Io_Service_Manager;
+using net::Socket_Options;
+using net::Tcp;
+using net::Tcp_Pool;
+using net::Tcp_Pool_Manager;
+using net::Timer_Wheel;
+
+using std::lock_guard;
+using std::make_shared;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+shared_ptr<Tcp_Pool_Manager> Tcp_Pool_Manager::create(time_duration idle_timeout,
+                                                      size_t max_connections,
+                                                      size_t max_connections_per_host)
+{
+    return create(idle_timeout, max_connections, max_connections_per_host,
+                  make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual));
+}
+
+shared_ptr<Tcp_Pool_Manager> Tcp_Pool_Manager::create(time_duration idle_timeout,
+                                                      size_t max_connections,
+                                                      size_t max_connections_per_host,
+                                                      shared_ptr<Io_Service_Manager> shared_io_service)
+{
+    return shared_ptr<Tcp_Pool_Manager>( new Tcp_Pool_Manager(idle_timeout, max_connections,
+                                                              max_connections_per_host,
+                                                              shared_io_service) );
+}
+
+Tcp_Pool_Manager::Tcp_Pool_Manager(time_duration idle_timeout_,
+                                   size_t max_connections_,
+                                   size_t max_connections_per_host_,
+                                   shared_ptr<Io_Service_Manager> io_service_manager_)
+  : io_service_manager(io_service_manager_),
+    idle_timers(Timer_Wheel::shared(io_service_manager, Tcp_Pool::idle_timer_tick(idle_timeout_))),
+    idle_timeout(idle_timeout_),
+    max_connections(max_connections_),
+    max_connections_per_host(max_connections_per_host_),
+    open_connections(0),
+    budget_starved(false)
+{}
+
+shared_ptr<Tcp_Pool> Tcp_Pool_Manager::get_pool(const string& host, const string& service)
+{
+    lock_guard<mutex> lck(lock);
+
+    auto& pool = pools[std::make_pair(host, service)];
+    if (!pool)
+    {
+        Logger::get()->debug("Tcp_Pool_Manager: creating pool for {}:{}", host, service);
+        pool = shared_ptr<Tcp_Pool>( new Tcp_Pool(host, service, idle_timeout,
+                                                  io_service_manager,
+                                                  shared_from_this(), Socket_Options()) );
+        pool->set_max_connections(max_connections_per_host);
+    }
+    return pool;
+}
+
+Tcp_Pool::Tcp_Guard Tcp_Pool_Manager::get(const string& host, const string& service)
+{
+    return get_pool(host, service)->get();
+}
+
+future<Tcp_Pool::Tcp_Guard> Tcp_Pool_Manager::async_get(const string& host,
+                                                        const string& service)
+{
+    return get_pool(host, service)->async_get();
+}
+
+void Tcp_Pool_Manager::async_get(const string& host, const string& service,
+                                 Tcp_Pool::Get_Handler_t handler)
+{
+    get_pool(host, service)->async_get(handler);
+}
+
+size_t Tcp_Pool_Manager::open_count()
+{
+    lock_guard<mutex> lck(lock);
+    return open_connections;
+}
+
+size_t Tcp_Pool_Manager::pool_count()
+{
+    lock_guard<mutex> lck(lock);
+    return pools.size();
+}
+
+bool Tcp_Pool_Manager::reserve_connection()
+{
+    {
+        lock_guard<mutex> lck(lock);
+        if (max_connections == 0 or open_connections < max_connections)
+        {
+            ++open_connections;
+            return true;
+        }
+    }
+
+    // At the budget. Close the least recently used idle connection of any host and take over
+    // its slot. Retry if another caller took that connection first.
+    auto candidates = all_pools();
+    while (true)
+    {
+        shared_ptr<Tcp_Pool> victim;
+        ptime oldest;
+        for (auto& pool : candidates)
+        {
+            ptime idle_since = pool->oldest_idle_since();
+            if (!idle_since.is_not_a_date_time() and (!victim or idle_since < oldest))
+            {
+                victim = pool;
+                oldest = idle_since;
+            }
+        }
+
+        if (!victim)
+        {
+            Logger::get()->debug("Tcp_Pool_Manager: at max connections with none idle");
+            budget_starved = true;
+            return false;
+        }
+
+        unique_ptr<Tcp> evicted = victim->evict_oldest_idle();
+        if (evicted)
+        {
+            return true;
+        }
+    }
+}
+
+void Tcp_Pool_Manager::release_connection()
+{
+    {
+        lock_guard<mutex> lck(lock);
+        --open_connections;
+    }
+
+    // Serve every waiter that can get a slot, evicting idle connections where needed. A
+    // waiter still short of the budget marks the manager starved again. waiter_count is read
+    // without the pool's lock; a caller not counted yet retries for a slot itself once it
+    // is queued, see Tcp_Pool::async_get().
+    budget_starved = false;
+    for (auto& pool : all_pools())
+    {
+        while (pool->waiter_count > 0 and pool->open_slot_for_waiter())
+        {}
+    }
+}
+
+vector<shared_ptr<Tcp_Pool>> Tcp_Pool_Manager::all_pools()
+{
+    lock_guard<mutex> lck(lock);
+
+    vector<shared_ptr<Tcp_Pool>> all;
+    all.reserve(pools.size());
+    for (auto& entry : pools)
+    {
+        all.push_back(entry.second);
+    }
+    return all;
+}
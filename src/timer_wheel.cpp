@@ -0,0 +1,194 @@
+#include "timer_wheel.h"
+
+#include "logger.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "boost_config.h"
+
+using boost::asio::deadline_timer;
+using boost::posix_time::time_duration;
+using boost::system::error_code;
+
+using net::Io_Service_Manager;
+using net::Timer_Wheel;
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::vector;
+using std::weak_ptr;
+
+shared_ptr<Timer_Wheel> Timer_Wheel::create(shared_ptr<Io_Service_Manager> io_service_manager,
+                                            time_duration tick,
+                                            size_t num_slots)
+{
+    return shared_ptr<Timer_Wheel>( new Timer_Wheel(io_service_manager, tick, num_slots) );
+}
+
+std::map<Timer_Wheel::Registry_Key_t, weak_ptr<Timer_Wheel>> Timer_Wheel::registry;
+mutex Timer_Wheel::registry_lock;
+
+shared_ptr<Timer_Wheel> Timer_Wheel::shared(shared_ptr<Io_Service_Manager> io_service_manager,
+                                            time_duration tick)
+{
+    lock_guard<mutex> lck(registry_lock);
+
+    // Forget the wheels whose users are gone.
+    for (auto it = registry.begin(); it != registry.end(); )
+    {
+        it = it->second.expired() ? registry.erase(it) : std::next(it);
+    }
+
+    auto& entry = registry[std::make_pair(io_service_manager.get(), tick.total_microseconds())];
+    auto wheel = entry.lock();
+    if (!wheel)
+    {
+        wheel = create(io_service_manager, tick);
+        entry = wheel;
+    }
+    return wheel;
+}
+
+Timer_Wheel::Timer_Wheel(shared_ptr<Io_Service_Manager> io_service_manager_,
+                         time_duration tick_,
+                         size_t num_slots)
+  : io_service_manager(io_service_manager_),
+    tick_timer(io_service_manager->get()),
+    tick(tick_),
+    slots(num_slots),
+    cursor(0),
+    ticking(false),
+    next_id(0)
+{
+    if (tick <= time_duration(0, 0, 0) or num_slots == 0)
+    {
+        throw std::invalid_argument("Timer_Wheel: tick must be positive and num_slots non zero");
+    }
+}
+
+// Timers still armed are dropped without firing.
+Timer_Wheel::~Timer_Wheel()
+{
+    error_code ec;
+    tick_timer.cancel(ec);
+}
+
+Timer_Wheel::Timer_Id_t Timer_Wheel::arm(time_duration delay, Handler_t handler)
+{
+    lock_guard<mutex> lck(lock);
+
+    auto now = deadline_timer::traits_type::now();
+    if (!ticking)
+    {
+        next_tick = now + tick;
+    }
+
+    // Count ticks from the next one, which may be less than a whole tick away, so the timer
+    // never fires before its delay.
+    int64_t remaining = std::max<int64_t>(0, (delay - (next_tick - now)).total_microseconds());
+    int64_t tick_us = tick.total_microseconds();
+    size_t ticks = 1 + static_cast<size_t>((remaining + tick_us - 1) / tick_us);
+
+    size_t slot = (cursor + ticks) % slots.size();
+    Timer_Id_t id = next_id++;
+    auto it = slots[slot].insert(slots[slot].end(),
+                                 Entry { id, (ticks - 1) / slots.size(), std::move(handler) });
+    index.emplace(id, std::make_pair(slot, it));
+
+    if (!ticking)
+    {
+        ticking = true;
+        schedule_tick();
+    }
+
+    return id;
+}
+
+bool Timer_Wheel::cancel(Timer_Id_t id)
+{
+    lock_guard<mutex> lck(lock);
+
+    auto found = index.find(id);
+    if (found == index.end())
+    {
+        return false;
+    }
+
+    // The tick stops by itself once it finds the wheel empty.
+    slots[found->second.first].erase(found->second.second);
+    index.erase(found);
+    return true;
+}
+
+size_t Timer_Wheel::pending()
+{
+    lock_guard<mutex> lck(lock);
+    return index.size();
+}
+
+void Timer_Wheel::schedule_tick()
+{
+    weak_ptr<Timer_Wheel> wp(shared_from_this());
+    tick_timer.expires_at(next_tick);
+    tick_timer.async_wait([wp] (const error_code& ec)
+        {
+            if (auto sp = wp.lock())
+            {
+                sp->handle_tick(ec);
+            }
+        }
+    );
+}
+
+void Timer_Wheel::handle_tick(const error_code& ec)
+{
+    if (ec)
+    {
+        Logger::get()->debug("Timer_Wheel::handle_tick {}", ec.message());
+        return;
+    }
+
+    vector<std::pair<Timer_Id_t, Handler_t>> due;
+    {
+        lock_guard<mutex> lck(lock);
+
+        // Catch up on every tick that passed while the io_service was busy.
+        auto now = deadline_timer::traits_type::now();
+        while (next_tick <= now)
+        {
+            cursor = (cursor + 1) % slots.size();
+            Slot_t& slot = slots[cursor];
+            for (auto it = slot.begin(); it != slot.end(); )
+            {
+                if (it->rounds > 0)
+                {
+                    --it->rounds;
+                    ++it;
+                    continue;
+                }
+
+                due.emplace_back(it->id, std::move(it->handler));
+                index.erase(it->id);
+                it = slot.erase(it);
+            }
+            next_tick += tick;
+        }
+
+        if (index.empty())
+        {
+            ticking = false;
+        }
+        else
+        {
+            schedule_tick();
+        }
+    }
+
+    for (auto& timer : due)
+    {
+        timer.second(timer.first);
+    }
+}
@@ -0,0 +1,68 @@
+#include "logger.h"
+#include "servers/tcp_server.h"
+#include "tcp_pool.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+using boost::posix_time::seconds;
+
+using std::cout; using std::cerr; using std::endl;
+using std::string;
+
+using net::Logger;
+using net::Tcp_Pool;
+using net::Tcp_Server;
+
+// Measures get() / guard release throughput of a single pool as the number of threads
+// sharing it grows. Connections are only created on the first checkouts so the numbers
+// reflect contention on the pool's idle list rather than the network.
+int main(int argc, char* argv[]) {
+    try {
+        if (argc > 3) {
+            cerr << "Usage: ./tcp_pool_contention [port] [checkouts per thread]" << endl;
+            return 1;
+        }
+
+        int port = argc > 1 ? std::atoi(argv[1]) : 9300;
+        int checkouts = argc > 2 ? std::atoi(argv[2]) : 100000;
+
+        // Construct the logger first since it sets its own level.
+        Logger::get();
+        Logger::set_level(spdlog::level::warn);
+
+        Tcp_Server server(Tcp_Server::Role_t::Echo, port);
+
+        for (int num_threads : { 1, 2, 4, 8, 16, 32, 64 }) {
+            auto pool = Tcp_Pool::create("localhost", std::to_string(port), seconds(30));
+
+            auto start = std::chrono::steady_clock::now();
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < num_threads; ++t) {
+                threads.emplace_back([&pool, checkouts] {
+                    for (int i = 0; i < checkouts; ++i) {
+                        Tcp_Pool::Tcp_Guard client = pool->get();
+                    }
+                });
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            double total = double(num_threads) * checkouts;
+            cout << num_threads << " threads: " << total / elapsed.count() << " checkouts/sec ("
+                 << pool->open_count() << " connections)" << endl;
+        }
+    }
+    catch (std::exception& e) {
+        cerr << "Exception: " << e.what() << endl;
+    }
+}
@@ -0,0 +1,84 @@
+#include "logger.h"
+#include "io_service_manager.h"
+#include "servers/tcp_echo_session.h"
+#include "servers/tcp_server.h"
+#include "servers/tcp_static_echo_session.h"
+#include "tcp_pipeline.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+
+using std::cout; using std::cerr; using std::endl;
+using std::make_shared;
+using std::string;
+
+using net::Io_Service_Manager;
+using net::Logger;
+using net::Tcp_Echo_Session;
+using net::Tcp_Pipeline;
+using net::Tcp_Server;
+using net::Tcp_Static_Echo_Session;
+
+// Pipelines echo requests through one connection and reports the messages/sec the server
+// handles, so the per message cost of the session's callbacks isn't hidden behind round trips.
+static double echo_rate(const Tcp_Server::Session_Factory& sessions, int port, int messages)
+{
+    Tcp_Server server(sessions, port);
+    auto io_service = make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual);
+    Tcp_Pipeline pipeline("localhost", std::to_string(port), io_service);
+
+    const string request = "ping\n";
+    const int window = 256;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Tcp_Pipeline::Response_Return_t> responses;
+    for (int sent = 0; sent < messages; sent += window) {
+        for (int i = sent; i < messages and i < sent + window; ++i) {
+            responses.push_back(pipeline.request(request, "\n"));
+        }
+        for (auto& response : responses) {
+            response.get();
+        }
+        responses.clear();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return messages / elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        if (argc > 3) {
+            cerr << "Usage: ./tcp_session_dispatch [port] [messages per run]" << endl;
+            return 1;
+        }
+
+        int port = argc > 1 ? std::atoi(argv[1]) : 9310;
+        int messages = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+        // Construct the logger first since it sets its own level.
+        Logger::get();
+        Logger::set_level(spdlog::level::warn);
+
+        // Alternate the two so drift in the machine's load affects both alike.
+        for (int run = 0; run < 3; ++run) {
+            double virtual_rate = echo_rate(
+                Tcp_Server::Session_Factory::pooled<Tcp_Echo_Session>(), port, messages);
+            double static_rate = echo_rate(
+                Tcp_Server::Session_Factory::pooled<Tcp_Static_Echo_Session>(), port, messages);
+
+            cout << "run " << run << ": virtual " << virtual_rate << " msgs/sec, static "
+                 << static_rate << " msgs/sec" << endl;
+        }
+    }
+    catch (std::exception& e) {
+        cerr << "Exception: " << e.what() << endl;
+    }
+}
@@ -0,0 +1,114 @@
+#define BOOST_TEST_DYN_LINK
+
+#include "buffer_pool.h"
+
+#include <memory>
+#include <string>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using boost::asio::buffer;
+using boost::asio::buffer_copy;
+using boost::asio::streambuf;
+
+using net::Buffer_Pool;
+
+struct A_Small_Buffer_Pool
+{
+    A_Small_Buffer_Pool() : pool({ 4096, 512 }, 2)
+    {}
+
+    // Writes size bytes into buf.
+    void fill(Buffer_Pool::Buffer_t buf, size_t size)
+    {
+        std::string data(size, 'x');
+        buf->commit(buffer_copy(buf->prepare(size), buffer(data)));
+    }
+
+    Buffer_Pool pool;
+};
+
+BOOST_FIXTURE_TEST_SUITE( buffer_pool_suite, A_Small_Buffer_Pool )
+
+    BOOST_AUTO_TEST_CASE( check_chunk_sizes_are_sorted )
+    {
+        BOOST_TEST( (pool.get_chunk_sizes() == std::vector<size_t>{ 512, 4096 }) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_acquired_buffer_is_empty_and_reserved )
+    {
+        auto buf = pool.acquire(1000);
+
+        BOOST_TEST( buf->size() == 0 );
+        BOOST_TEST( buf->capacity() >= 4096 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_released_buffer_is_reused )
+    {
+        auto buf = pool.acquire();
+        streambuf* raw = buf.get();
+        fill(buf, 100);
+        buf.reset();
+
+        BOOST_TEST( pool.cached() == 1 );
+
+        buf = pool.acquire();
+        BOOST_TEST( buf.get() == raw );
+        BOOST_TEST( buf->size() == 0 );
+        BOOST_TEST( pool.cached() == 0 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_small_request_doesnt_take_large_buffer )
+    {
+        pool.acquire(4096).reset();
+        auto buf = pool.acquire(100);
+
+        BOOST_TEST( pool.cached() == 1 );
+        BOOST_TEST( buf->capacity() < 4096 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_cache_is_bounded )
+    {
+        auto buf1 = pool.acquire();
+        auto buf2 = pool.acquire();
+        auto buf3 = pool.acquire();
+        buf1.reset();
+        buf2.reset();
+        buf3.reset();
+
+        BOOST_TEST( pool.cached() == 2 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_grown_buffer_is_freed )
+    {
+        auto buf = pool.acquire();
+        fill(buf, 10000);
+        buf.reset();
+
+        BOOST_TEST( pool.cached() == 0 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_oversized_request_is_served )
+    {
+        auto buf = pool.acquire(10000);
+        BOOST_TEST( buf->capacity() >= 10000 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_free_lists_are_per_thread )
+    {
+        pool.acquire().reset();
+
+        size_t other_thread_cached = 1;
+        boost::thread t([this, &other_thread_cached] ()
+            { other_thread_cached = pool.cached(); }
+        );
+        t.join();
+
+        BOOST_TEST( other_thread_cached == 0 );
+        BOOST_TEST( pool.cached() == 1 );
+    }
+
+BOOST_AUTO_TEST_SUITE_END() // buffer_pool_suite
@@ -0,0 +1,255 @@
+#define BOOST_TEST_DYN_LINK
+
+#include "http.h"
+#include "io_service_manager.h"
+#include "servers/tcp_base_session.h"
+#include "servers/tcp_server.h"
+
+#include <chrono>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+#include <boost/asio/spawn.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/future.hpp>
+
+using boost::asio::ip::tcp;
+using boost::asio::yield_context;
+using boost::system::error_code;
+using boost::system::system_error;
+
+using net::Http;
+using net::Http_Response;
+using net::Io_Service_Manager;
+using net::Tcp_Server;
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+
+static const int port_int = 9046;
+static const char* port_str = "9046";
+
+// Nothing listens here.
+static const char* closed_port_str = "9047";
+
+// Answers every request with a fixed response, leaving out the body for HEAD. The path picks
+// how the response is framed:
+//  /lower      names the length header in lower case
+//  /no-length  leaves out the length and closes the connection after the body
+//  /slow       answers after a delay
+class Hello_Session : public net::Tcp_Base_Session
+{
+    public:
+        Hello_Session(tcp::socket socket, shared_ptr<Io_Service_Manager> io_service)
+            : Tcp_Base_Session(std::move(socket), io_service),
+              delay(get_socket().get_executor()),
+              close_after_write(false)
+        {}
+
+        void start() override
+            { do_read("\r\n\r\n"); }
+
+    protected:
+        void do_read_work(shared_ptr<boost::asio::streambuf> req, error_code ec) override
+        {
+            if (ec)
+            {
+                return;
+            }
+
+            string method, path;
+            std::istream(req.get()) >> method >> path;
+
+            auto res = make_shared<boost::asio::streambuf>();
+            std::ostream out(res.get());
+            out << "HTTP/1.1 200 OK\r\n";
+            if (path == "/lower")
+            {
+                out << "content-length: 5\r\n";
+            }
+            else if (path != "/no-length")
+            {
+                out << "Content-Length: 5\r\n";
+            }
+            out << "Content-Type: text/plain\r\n\r\n"
+                << (method == "HEAD" ? "" : "hello");
+            close_after_write = path == "/no-length";
+
+            if (path != "/slow")
+            {
+                do_write(res);
+                return;
+            }
+
+            auto self(shared_from_this());
+            delay.expires_after(std::chrono::milliseconds(100));
+            delay.async_wait([this, self, res] (error_code) { do_write(res); });
+        }
+
+        void do_write_work(error_code ec, std::size_t) override
+        {
+            if (ec)
+            {
+                return;
+            }
+
+            if (close_after_write)
+            {
+                get_socket().shutdown(tcp::socket::shutdown_send, ec);
+                return;
+            }
+            do_read("\r\n\r\n");
+        }
+
+    private:
+        boost::asio::steady_timer delay;
+        bool close_after_write;
+};
+
+struct A_Running_Http_Server
+{
+    A_Running_Http_Server()
+        : s(Tcp_Server::Session_Factory::pooled<Hello_Session>(), port_int),
+          coroutine_service(Io_Service_Manager::Behavior_t::Perpetual)
+    {}
+
+    Tcp_Server s;
+    Io_Service_Manager coroutine_service;
+};
+
+BOOST_FIXTURE_TEST_SUITE( http_suite, A_Running_Http_Server )
+
+    BOOST_AUTO_TEST_SUITE( coroutines )
+
+        BOOST_AUTO_TEST_CASE( check_get_reads_status_headers_and_body )
+        {
+            Http client("localhost", port_str);
+            boost::promise<Http_Response> response;
+
+            boost::asio::spawn(coroutine_service.get(), [&] (yield_context yield)
+                {
+                    response.set_value(client.get("/", yield));
+                }
+            );
+
+            Http_Response res = response.get_future().get();
+            BOOST_TEST( res.status == "HTTP/1.1 200 OK" );
+            BOOST_TEST( res.headers["Content-Length"] == "5" );
+            BOOST_TEST( res.headers["Content-Type"] == "text/plain" );
+            BOOST_TEST( res.body == "hello" );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_head_skips_the_body )
+        {
+            Http client("localhost", port_str);
+            boost::promise<Http_Response> response;
+
+            boost::asio::spawn(coroutine_service.get(), [&] (yield_context yield)
+                {
+                    // Twice so the second request reuses the pooled connection.
+                    client.head("/", yield);
+                    response.set_value(client.head("/", yield));
+                }
+            );
+
+            Http_Response res = response.get_future().get();
+            BOOST_TEST( res.status == "HTTP/1.1 200 OK" );
+            BOOST_TEST( res.headers["Content-Length"] == "5" );
+            BOOST_TEST( res.body.empty() );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_connect_failure_throws )
+        {
+            Http client("localhost", closed_port_str);
+            boost::promise<error_code> failure;
+
+            boost::asio::spawn(coroutine_service.get(), [&] (yield_context yield)
+                {
+                    try
+                    {
+                        client.get("/", yield);
+                        failure.set_value(error_code());
+                    }
+                    catch (const system_error& e)
+                    {
+                        failure.set_value(e.code());
+                    }
+                }
+            );
+
+            BOOST_TEST( (failure.get_future().get() == boost::asio::error::connection_refused) );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_header_names_ignore_case )
+        {
+            Http client("localhost", port_str);
+            boost::promise<Http_Response> response;
+
+            boost::asio::spawn(coroutine_service.get(), [&] (yield_context yield)
+                {
+                    // The second request only reads its own response if the first body was
+                    // read in full.
+                    client.get("/lower", yield);
+                    response.set_value(client.get("/lower", yield));
+                }
+            );
+
+            Http_Response res = response.get_future().get();
+            BOOST_TEST( res.headers["Content-Length"] == "5" );
+            BOOST_TEST( res.headers["content-type"] == "text/plain" );
+            BOOST_TEST( res.body == "hello" );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_body_without_length_is_read_until_close )
+        {
+            Http client("localhost", port_str);
+            boost::promise<Http_Response> unframed, next;
+
+            boost::asio::spawn(coroutine_service.get(), [&] (yield_context yield)
+                {
+                    // The closed connection isn't reused for the next request.
+                    unframed.set_value(client.get("/no-length", yield));
+                    next.set_value(client.get("/", yield));
+                }
+            );
+
+            Http_Response res = unframed.get_future().get();
+            BOOST_TEST( res.headers.count("Content-Length") == 0 );
+            BOOST_TEST( res.body == "hello" );
+            BOOST_TEST( next.get_future().get().body == "hello" );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_request_waits_for_a_connection_at_the_cap )
+        {
+            Http client("localhost", port_str);
+            client.set_max_connections(1);
+            boost::promise<Http_Response> first, second;
+
+            // Both coroutines share the service's only worker, so the second one has to
+            // suspend while the first one holds the connection.
+            boost::asio::spawn(coroutine_service.get(), [&] (yield_context yield)
+                { first.set_value(client.get("/slow", yield)); }
+            );
+            boost::asio::spawn(coroutine_service.get(), [&] (yield_context yield)
+                { second.set_value(client.get("/", yield)); }
+            );
+
+            auto second_fut = second.get_future();
+            for (int i = 0; i < 500 and !second_fut.is_ready(); ++i)
+            {
+                boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+            }
+            BOOST_TEST( second_fut.is_ready() );
+            BOOST_TEST( first.get_future().get().body == "hello" );
+            BOOST_TEST( second_fut.get().body == "hello" );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END() // coroutines
+
+BOOST_AUTO_TEST_SUITE_END() // http_suite
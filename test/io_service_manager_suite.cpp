@@ -2,6 +2,12 @@
 
 #include "io_service_manager.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "boost_config.h"
 #include <boost/asio.hpp>
 #include <boost/test/unit_test.hpp>
@@ -20,6 +26,17 @@ struct A_Running_Perpetual_Service
     Io_Service_Manager service;
 };
 
+static const size_t num_workers = 4;
+
+struct A_Running_Multi_Worker_Service
+{
+    A_Running_Multi_Worker_Service()
+        : service(Io_Service_Manager::Behavior_t::Perpetual, num_workers)
+    {}
+
+    Io_Service_Manager service;
+};
+
 struct A_Stopped_Perpetual_Service : public A_Running_Perpetual_Service
 {
     A_Stopped_Perpetual_Service() : A_Running_Perpetual_Service()
@@ -146,4 +163,111 @@ BOOST_AUTO_TEST_SUITE( io_service_manager_suite )
 
     BOOST_AUTO_TEST_SUITE_END() // perpetual_behavior
 
+    BOOST_FIXTURE_TEST_SUITE( multiple_workers, A_Running_Multi_Worker_Service )
+
+        BOOST_AUTO_TEST_CASE( check_worker_count )
+        {
+            BOOST_TEST( service.worker_count() == num_workers );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_default_worker_count_is_one )
+        {
+            Io_Service_Manager single(Io_Service_Manager::Behavior_t::Perpetual);
+            BOOST_TEST( single.worker_count() == 1 );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_zero_workers_uses_hardware_concurrency )
+        {
+            Io_Service_Manager hw(Io_Service_Manager::Behavior_t::Perpetual, 0);
+            BOOST_TEST( hw.worker_count() >= 1 );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_work_runs_concurrently_on_all_workers )
+        {
+            // Every handler blocks until all of them are running. This can only
+            // finish if each one is executed by a different worker.
+            std::mutex lock;
+            std::condition_variable all_running;
+            size_t running = 0;
+
+            std::vector<future<bool>> futs;
+            for (size_t i = 0; i < num_workers; ++i)
+            {
+                auto prom = std::make_shared<promise<bool>>();
+                futs.push_back(prom->get_future());
+                service.get().post([&, prom]()
+                    {
+                        std::unique_lock<std::mutex> lck(lock);
+                        ++running;
+                        all_running.notify_all();
+                        bool ok = all_running.wait_for(lck, std::chrono::seconds(5),
+                                                       [&]() { return running == num_workers; });
+                        prom->set_value(ok);
+                    }
+                );
+            }
+
+            for (auto& fut : futs)
+            {
+                BOOST_TEST( fut.get() == true );
+            }
+        }
+
+        BOOST_AUTO_TEST_CASE( check_stopping_from_a_worker_throws )
+        {
+            promise<bool> prom;
+            future<bool> fut = prom.get_future();
+            service.get().post([&]()
+                {
+                    try
+                    {
+                        service.stop();
+                        prom.set_value(false);
+                    }
+                    catch (std::logic_error&)
+                    {
+                        prom.set_value(true);
+                    }
+                }
+            );
+
+            BOOST_TEST( fut.get() == true );
+            BOOST_TEST( service.is_running() );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_worker_can_release_the_last_reference )
+        {
+            auto owned = std::make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual,
+                                                              num_workers);
+            promise<bool> prom;
+            future<bool> fut = prom.get_future();
+
+            // The handler destroys the manager and then keeps running on its io_service.
+            owned->get().post([&prom, owned]() mutable
+                {
+                    owned.reset();
+                    prom.set_value(true);
+                }
+            );
+            owned.reset();
+
+            BOOST_TEST( fut.get() == true );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_stopping_and_restarting_works )
+        {
+            BOOST_CHECK_NO_THROW( service.stop() );
+            BOOST_TEST( !service.is_running() );
+
+            BOOST_CHECK_NO_THROW( service.start() );
+            BOOST_TEST( service.is_running() );
+
+            promise<bool> prom;
+            future<bool> fut = prom.get_future();
+            service.get().post([&]() { prom.set_value(true); });
+            BOOST_TEST( fut.get() == true );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END() // multiple_workers
+
 BOOST_AUTO_TEST_SUITE_END() // io_service_manager_suite
@@ -0,0 +1,167 @@
+#define BOOST_TEST_DYN_LINK
+
+#include "io_service_pool.h"
+
+#include <memory>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/future.hpp>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+using boost::future;
+using boost::promise;
+
+using net::Io_Service_Manager;
+using net::Io_Service_Pool;
+
+using std::shared_ptr;
+using std::vector;
+
+static const size_t num_shards = 3;
+
+struct A_Round_Robin_Pool
+{
+    A_Round_Robin_Pool() : pool(num_shards, Io_Service_Pool::Placement_t::Round_Robin, true)
+    {}
+
+    Io_Service_Pool pool;
+};
+
+struct A_Least_Loaded_Pool
+{
+    A_Least_Loaded_Pool() : pool(num_shards, Io_Service_Pool::Placement_t::Least_Loaded, false)
+    {}
+
+    Io_Service_Pool pool;
+};
+
+BOOST_AUTO_TEST_SUITE( io_service_pool_suite )
+
+    BOOST_FIXTURE_TEST_SUITE( round_robin, A_Round_Robin_Pool )
+
+        BOOST_AUTO_TEST_CASE( check_pool_size )
+        {
+            BOOST_TEST( pool.size() == num_shards );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_every_shard_is_running_one_worker )
+        {
+            for (size_t i = 0; i < pool.size(); ++i)
+            {
+                BOOST_TEST( pool.get(i)->is_running() );
+                BOOST_TEST( pool.get(i)->worker_count() == 1 );
+            }
+        }
+
+        BOOST_AUTO_TEST_CASE( check_shards_are_handed_out_in_order )
+        {
+            for (size_t i = 0; i < 2 * num_shards; ++i)
+            {
+                BOOST_TEST( pool.next() == pool.get(i % num_shards) );
+            }
+        }
+
+        BOOST_AUTO_TEST_CASE( check_pinned_shard_runs_work )
+        {
+            promise<bool> prom;
+            future<bool> fut = prom.get_future();
+            pool.next()->get().post([&]() { prom.set_value(true); });
+
+            BOOST_TEST( fut.get() == true );
+        }
+
+#if defined(__linux__)
+        BOOST_AUTO_TEST_CASE( check_shards_are_pinned_to_allowed_cpus )
+        {
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            BOOST_REQUIRE( sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0 );
+
+            for (size_t i = 0; i < pool.size(); ++i)
+            {
+                promise<cpu_set_t> prom;
+                future<cpu_set_t> fut = prom.get_future();
+                pool.get(i)->get().post([&]()
+                    {
+                        cpu_set_t pinned;
+                        CPU_ZERO(&pinned);
+                        sched_getaffinity(0, sizeof(cpu_set_t), &pinned);
+                        prom.set_value(pinned);
+                    }
+                );
+
+                cpu_set_t pinned = fut.get();
+                cpu_set_t outside;
+                CPU_XOR(&outside, &pinned, &allowed);
+                CPU_AND(&outside, &outside, &pinned);
+                BOOST_TEST( CPU_COUNT(&pinned) == 1 );
+                BOOST_TEST( CPU_COUNT(&outside) == 0 );
+            }
+        }
+#endif
+
+    BOOST_AUTO_TEST_SUITE_END() // round_robin
+
+    BOOST_FIXTURE_TEST_SUITE( least_loaded, A_Least_Loaded_Pool )
+
+        BOOST_AUTO_TEST_CASE( check_load_counts_placed_objects )
+        {
+            auto shard = pool.place(0);
+            BOOST_TEST( pool.load(0) == 1 );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_load_counts_each_placement_once )
+        {
+            auto placed = pool.place(0);
+            auto copy = placed;
+            auto unplaced = pool.get(0);
+            BOOST_TEST( pool.load(0) == 1 );
+
+            placed.reset();
+            BOOST_TEST( pool.load(0) == 1 );
+            copy.reset();
+            BOOST_TEST( pool.load(0) == 0 );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_placements_may_outlive_the_pool )
+        {
+            shared_ptr<Io_Service_Manager> placed;
+            {
+                Io_Service_Pool short_lived(1, Io_Service_Pool::Placement_t::Least_Loaded, false);
+                placed = short_lived.next();
+            }
+            BOOST_TEST( !placed->is_running() );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_placements_are_spread_evenly )
+        {
+            vector<shared_ptr<Io_Service_Manager>> placed;
+            for (size_t i = 0; i < 2 * num_shards; ++i)
+            {
+                placed.push_back(pool.next());
+            }
+
+            for (size_t i = 0; i < num_shards; ++i)
+            {
+                BOOST_TEST( pool.load(i) == 2 );
+            }
+        }
+
+        BOOST_AUTO_TEST_CASE( check_least_loaded_shard_is_picked )
+        {
+            auto held1 = pool.place(0);
+            auto held2 = pool.place(1);
+            auto picked = pool.next();
+
+            BOOST_TEST( picked == pool.get(2) );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END() // least_loaded
+
+BOOST_AUTO_TEST_SUITE_END() // io_service_pool_suite
@@ -0,0 +1,121 @@
+#define BOOST_TEST_DYN_LINK
+
+#include "resolver_cache.h"
+
+#include <string>
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using boost::asio::ip::address;
+using boost::asio::ip::tcp;
+using boost::posix_time::milliseconds;
+using boost::posix_time::seconds;
+using boost::system::error_code;
+
+using net::Resolver_Cache;
+
+struct A_Small_Resolver_Cache
+{
+    A_Small_Resolver_Cache()
+        : cache(seconds(60), milliseconds(10), 2),
+          endpoints { tcp::endpoint(address::from_string("127.0.0.1"), 80) }
+    {}
+
+    Resolver_Cache cache;
+    Resolver_Cache::Endpoints_t endpoints;
+    Resolver_Cache::Endpoints_t found;
+    error_code ec;
+};
+
+BOOST_FIXTURE_TEST_SUITE( resolver_cache_suite, A_Small_Resolver_Cache )
+
+    BOOST_AUTO_TEST_CASE( check_miss_on_empty_cache )
+    {
+        BOOST_TEST( !cache.lookup("localhost", "80", found, ec) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_hit_returns_inserted_endpoints )
+    {
+        cache.insert("localhost", "80", endpoints);
+
+        BOOST_TEST( cache.lookup("localhost", "80", found, ec) );
+        BOOST_TEST( !ec );
+        BOOST_TEST( (found == endpoints) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_entries_are_keyed_by_host_and_service )
+    {
+        cache.insert("localhost", "80", endpoints);
+
+        BOOST_TEST( !cache.lookup("localhost", "81", found, ec) );
+        BOOST_TEST( !cache.lookup("example.com", "80", found, ec) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_ipv6_hosts_dont_collide_with_services )
+    {
+        cache.insert("::1", "80", endpoints);
+
+        BOOST_TEST( !cache.lookup("::1:80", "", found, ec) );
+        BOOST_TEST( cache.lookup("::1", "80", found, ec) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_negative_entry_returns_error_until_expired )
+    {
+        cache.insert_error("nowhere", "80", boost::asio::error::host_not_found);
+
+        BOOST_TEST( cache.lookup("nowhere", "80", found, ec) );
+        BOOST_TEST( (ec == boost::asio::error::host_not_found) );
+        BOOST_TEST( found.empty() );
+
+        boost::this_thread::sleep(milliseconds(20));
+
+        BOOST_TEST( !cache.lookup("nowhere", "80", found, ec) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_cancelled_lookup_is_not_cached )
+    {
+        cache.insert_error("nowhere", "80", boost::asio::error::operation_aborted);
+
+        BOOST_TEST( !cache.lookup("nowhere", "80", found, ec) );
+        BOOST_TEST( cache.size() == 0 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_least_recently_used_entry_is_evicted )
+    {
+        cache.insert("a", "80", endpoints);
+        cache.insert("b", "80", endpoints);
+
+        // Touch a so b is the least recently used.
+        cache.lookup("a", "80", found, ec);
+        cache.insert("c", "80", endpoints);
+
+        BOOST_TEST( cache.size() == 2 );
+        BOOST_TEST( cache.lookup("a", "80", found, ec) );
+        BOOST_TEST( !cache.lookup("b", "80", found, ec) );
+        BOOST_TEST( cache.lookup("c", "80", found, ec) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_invalidate_removes_entry )
+    {
+        cache.insert("localhost", "80", endpoints);
+        cache.invalidate("localhost", "80");
+
+        BOOST_TEST( !cache.lookup("localhost", "80", found, ec) );
+        BOOST_TEST( cache.size() == 0 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_resolve_caches_result )
+    {
+        boost::asio::io_service io_service;
+
+        found = cache.resolve(io_service, "localhost", "80", ec);
+
+        BOOST_TEST( !ec );
+        BOOST_TEST( !found.empty() );
+        BOOST_TEST( cache.lookup("localhost", "80", found, ec) );
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,22 +1,63 @@
 #define BOOST_TEST_DYN_LINK
 
 #include "servers/tcp_server.h"
+#include "servers/tcp_static_echo_session.h"
 #include "tcp.h"
 
 #include "boost_config.h"
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
 #include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
 
+using net::Io_Service_Manager;
+using net::Io_Service_Pool;
 using net::Tcp;
 using net::Tcp_Server;
 
+using boost::asio::ip::tcp;
+using boost::system::error_code;
+
 using std::make_shared;
 using std::shared_ptr;
 
 static const int port_int = 9005;
 static const char* port_str = "9005";
 
+// Answers every line with "ack\n".
+class Ack_Session : public net::Tcp_Base_Session
+{
+    public:
+        Ack_Session(tcp::socket socket, shared_ptr<Io_Service_Manager> io_service)
+            : Tcp_Base_Session(std::move(socket), io_service)
+        {}
+
+        void start() override
+            { do_read("\n"); }
+
+    protected:
+        void do_read_work(shared_ptr<boost::asio::streambuf>, error_code ec) override
+        {
+            if (!ec)
+            {
+                auto ack = make_shared<boost::asio::streambuf>();
+                std::ostream(ack.get()) << "ack\n";
+                do_write(ack);
+            }
+        }
+
+        void do_write_work(error_code ec, std::size_t) override
+        {
+            if (!ec)
+            {
+                do_read("\n");
+            }
+        }
+};
+
 struct A_Running_Echo_Server
 {
     A_Running_Echo_Server() : s(Tcp_Server::Role_t::Echo, port_int) {}
@@ -24,6 +65,61 @@ struct A_Running_Echo_Server
     Tcp_Server s;
 };
 
+struct A_Running_Echo_Server_On_A_Shared_Service
+{
+    A_Running_Echo_Server_On_A_Shared_Service()
+        : io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual)),
+          s(Tcp_Server::Role_t::Echo, port_int, io_service)
+    {}
+
+    shared_ptr<Io_Service_Manager> io_service;
+    Tcp_Server s;
+};
+
+struct A_Running_Echo_Server_On_A_Sharded_Pool
+{
+    A_Running_Echo_Server_On_A_Sharded_Pool()
+        : pool(make_shared<Io_Service_Pool>(2, Io_Service_Pool::Placement_t::Least_Loaded, false)),
+          s(Tcp_Server::Role_t::Echo, port_int, pool)
+    {}
+
+    shared_ptr<Io_Service_Pool> pool;
+    Tcp_Server s;
+};
+
+struct A_Running_Echo_Server_With_Reuse_Port_Acceptors
+{
+    A_Running_Echo_Server_With_Reuse_Port_Acceptors()
+        : pool(make_shared<Io_Service_Pool>(2, Io_Service_Pool::Placement_t::Round_Robin, false)),
+          s(Tcp_Server::Role_t::Echo, port_int, pool, Tcp_Server::Listen_Mode_t::Reuse_Port)
+    {}
+
+    shared_ptr<Io_Service_Pool> pool;
+    Tcp_Server s;
+};
+
+struct A_Running_Echo_Server_Accepting_In_Batches
+{
+    A_Running_Echo_Server_Accepting_In_Batches()
+        : io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual)),
+          s(Tcp_Server::Role_t::Echo, port_int, io_service, net::Socket_Options(), batched())
+    {}
+
+    static const size_t max_batch = 8;
+
+    static Tcp_Server::Accept_Options batched()
+    {
+        Tcp_Server::Accept_Options accept_options;
+        accept_options.batch_accept = true;
+        accept_options.listen_backlog = 64;
+        accept_options.max_batch = max_batch;
+        return accept_options;
+    }
+
+    shared_ptr<Io_Service_Manager> io_service;
+    Tcp_Server s;
+};
+
 BOOST_AUTO_TEST_SUITE( tcp_server_suite )
 
     BOOST_FIXTURE_TEST_SUITE( echo_role, A_Running_Echo_Server )
@@ -40,9 +136,258 @@ BOOST_AUTO_TEST_SUITE( tcp_server_suite )
             // TODO
         }
 
+        BOOST_AUTO_TEST_CASE( check_finished_sessions_are_reused )
+        {
+            const std::string str = "hello\n";
+            boost::system::error_code ec;
+
+            for (int i = 0; i < 3; ++i)
+            {
+                {
+                    Tcp client("localhost", port_str);
+                    client.send(str, ec).get();
+                    BOOST_TEST( *client.receive(str.size(), ec).get() == str );
+                    BOOST_TEST( s.cached_sessions() == 0 );
+                }
+
+                // The session finishes once it reads the client's disconnection.
+                for (int wait = 0; wait < 100 and s.cached_sessions() == 0; ++wait)
+                {
+                    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+                }
+                BOOST_TEST( s.cached_sessions() == 1 );
+            }
+        }
+
         // TODO: check server internals when messages are recieved / sent ?
         // TODO: check accept loop?
 
     BOOST_AUTO_TEST_SUITE_END()
 
+    BOOST_FIXTURE_TEST_SUITE( shared_io_service, A_Running_Echo_Server_On_A_Shared_Service )
+
+        BOOST_AUTO_TEST_CASE( check_client_connection )
+        {
+            Tcp client("localhost", port_str, io_service);
+
+            BOOST_TEST( client.is_open() );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_stop_leaves_service_running )
+        {
+            s.stop();
+
+            BOOST_TEST( io_service->is_running() );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END()
+
+    BOOST_FIXTURE_TEST_SUITE( sharded_io_service, A_Running_Echo_Server_On_A_Sharded_Pool )
+
+        BOOST_AUTO_TEST_CASE( check_clients_on_shards_can_echo )
+        {
+            Tcp client1("localhost", port_str, pool->next());
+            Tcp client2("localhost", port_str, pool->next());
+            const std::string str = "hello\n";
+            boost::system::error_code ec;
+
+            BOOST_TEST( client1.send(str, ec).get() == str.size() );
+            BOOST_TEST( client2.send(str, ec).get() == str.size() );
+
+            BOOST_TEST( *client1.receive(str.size(), ec).get() == str );
+            BOOST_TEST( *client2.receive(str.size(), ec).get() == str );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_accepted_sessions_are_placed_on_shards )
+        {
+            Tcp client("localhost", port_str);
+            const std::string str = "hello\n";
+            boost::system::error_code ec;
+
+            // Round trip so the session is known to exist.
+            client.send(str, ec).get();
+            client.receive(str.size(), ec).get();
+
+            size_t total_load = 0;
+            for (size_t i = 0; i < pool->size(); ++i)
+            {
+                total_load += pool->load(i);
+            }
+
+            // Acceptor shard, the shard reserved for the next accept, and the session.
+            BOOST_TEST( total_load == 3 );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END()
+
+    BOOST_AUTO_TEST_SUITE( session_factories )
+
+        BOOST_AUTO_TEST_CASE( check_pooled_custom_sessions_run )
+        {
+            Tcp_Server s(Tcp_Server::Session_Factory::pooled<Ack_Session>(), port_int);
+            Tcp client("localhost", port_str);
+            const std::string str = "hello\n";
+            error_code ec;
+
+            client.send(str, ec).get();
+            BOOST_TEST( *client.receive(std::string("\n"), ec).get() == "ack\n" );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_static_sessions_run )
+        {
+            Tcp_Server s(Tcp_Server::Session_Factory::pooled<net::Tcp_Static_Echo_Session>(),
+                         port_int);
+            Tcp client("localhost", port_str);
+            const std::string first = "hello\n";
+            const std::string second = "world\n";
+            error_code ec;
+
+            client.send(first, ec).get();
+            BOOST_TEST( *client.receive(std::string("\n"), ec).get() == first );
+            client.send(second, ec).get();
+            BOOST_TEST( *client.receive(std::string("\n"), ec).get() == second );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_factory_outliving_its_server_caches_nothing )
+        {
+            auto sessions = Tcp_Server::Session_Factory::pooled<Ack_Session>();
+            const std::string str = "hello\n";
+            error_code ec;
+
+            for (int i = 0; i < 2; ++i)
+            {
+                Tcp_Server s(sessions, port_int);
+                BOOST_TEST( s.cached_sessions() == 0 );
+                {
+                    Tcp client("localhost", port_str);
+                    client.send(str, ec).get();
+                    BOOST_TEST( *client.receive(std::string("\n"), ec).get() == "ack\n" );
+                }
+
+                // The session finishes once it reads the client's disconnection.
+                for (int wait = 0; wait < 100 and s.cached_sessions() == 0; ++wait)
+                {
+                    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+                }
+                BOOST_TEST( s.cached_sessions() == 1 );
+            }
+        }
+
+        BOOST_AUTO_TEST_CASE( check_custom_create_function_runs )
+        {
+            std::atomic<int> created(0);
+            Tcp_Server s(Tcp_Server::Session_Factory(
+                [&created] (tcp::socket socket, shared_ptr<Io_Service_Manager> io_service)
+                    -> shared_ptr<net::Tcp_Base_Session>
+                {
+                    ++created;
+                    return make_shared<Ack_Session>(std::move(socket), io_service);
+                }), port_int);
+            Tcp client("localhost", port_str);
+            const std::string str = "hello\n";
+            error_code ec;
+
+            client.send(str, ec).get();
+            BOOST_TEST( *client.receive(std::string("\n"), ec).get() == "ack\n" );
+            BOOST_TEST( created == 1 );
+            BOOST_TEST( s.cached_sessions() == 0 );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_custom_create_function_runs_static_sessions )
+        {
+            Tcp_Server s(Tcp_Server::Session_Factory(
+                [] (tcp::socket socket, shared_ptr<Io_Service_Manager> io_service)
+                {
+                    return make_shared<net::Tcp_Static_Echo_Session>(std::move(socket), io_service);
+                }), port_int);
+            Tcp client("localhost", port_str);
+            const std::string str = "hello\n";
+            error_code ec;
+
+            client.send(str, ec).get();
+            BOOST_TEST( *client.receive(std::string("\n"), ec).get() == str );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END()
+
+    BOOST_FIXTURE_TEST_SUITE( batch_accept, A_Running_Echo_Server_Accepting_In_Batches )
+
+        BOOST_AUTO_TEST_CASE( check_burst_of_clients_is_accepted_in_batches )
+        {
+            const size_t num_clients = 3 * max_batch;
+
+            // Hold the acceptor's only worker so every connection queues up in the backlog.
+            boost::promise<void> release;
+            boost::shared_future<void> released = release.get_future().share();
+            io_service->get().post([released] () { released.wait(); });
+
+            std::vector<std::unique_ptr<Tcp>> clients;
+            for (size_t i = 0; i < num_clients; ++i)
+            {
+                clients.emplace_back(new Tcp("localhost", port_str));
+            }
+            release.set_value();
+
+            const std::string str = "hello\n";
+            boost::system::error_code ec;
+            for (auto& client : clients)
+            {
+                BOOST_TEST( client->send(str, ec).get() == str.size() );
+                BOOST_TEST( *client->receive(str.size(), ec).get() == str );
+            }
+
+            // Without batching every connection takes a wakeup of its own.
+            BOOST_TEST( s.accept_wakeups() == num_clients / max_batch );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_stop_leaves_service_running )
+        {
+            s.stop();
+
+            BOOST_TEST( io_service->is_running() );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END()
+
+    BOOST_FIXTURE_TEST_SUITE( reuse_port, A_Running_Echo_Server_With_Reuse_Port_Acceptors )
+
+        BOOST_AUTO_TEST_CASE( check_client_can_echo )
+        {
+            Tcp client("localhost", port_str);
+            const std::string str = "hello\n";
+            boost::system::error_code ec;
+
+            BOOST_TEST( client.send(str, ec).get() == str.size() );
+            BOOST_TEST( *client.receive(str.size(), ec).get() == str );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_connections_are_spread_across_acceptors )
+        {
+            std::vector<size_t> idle_load;
+            for (size_t i = 0; i < pool->size(); ++i)
+            {
+                idle_load.push_back(pool->load(i));
+            }
+
+            // The kernel hashes each connection to an acceptor, so with this many clients
+            // every acceptor gets some.
+            auto io_service = make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual);
+            std::vector<std::unique_ptr<Tcp>> clients;
+            const std::string str = "hello\n";
+            boost::system::error_code ec;
+            for (int i = 0; i < 32; ++i)
+            {
+                clients.emplace_back(new Tcp("localhost", port_str, io_service));
+                clients.back()->send(str, ec).get();
+                clients.back()->receive(str.size(), ec).get();
+            }
+
+            for (size_t i = 0; i < pool->size(); ++i)
+            {
+                BOOST_TEST( pool->load(i) > idle_load[i] );
+            }
+        }
+
+    BOOST_AUTO_TEST_SUITE_END()
+
 BOOST_AUTO_TEST_SUITE_END()
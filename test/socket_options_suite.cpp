@@ -0,0 +1,128 @@
+#define BOOST_TEST_DYN_LINK
+
+#include "io_service_manager.h"
+#include "socket_options.h"
+#include "tcp.h"
+#include "servers/tcp_server.h"
+
+#include <memory>
+#include <string>
+
+#include <sys/socket.h>     // getsockopt
+
+#include "boost_config.h"
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+using boost::asio::ip::tcp;
+using boost::system::error_code;
+
+using net::Io_Service_Manager;
+using net::Socket_Options;
+using net::Tcp;
+using net::Tcp_Server;
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+
+static const int port_int = 9015;
+static const char* port_str = "9015";
+
+struct An_Open_Socket
+{
+    An_Open_Socket() : socket(io_service)
+    {
+        socket.open(tcp::v4());
+    }
+
+    boost::asio::io_service io_service;
+    tcp::socket socket;
+};
+
+BOOST_AUTO_TEST_SUITE( socket_options_suite )
+
+    BOOST_FIXTURE_TEST_CASE( check_default_options_change_nothing, An_Open_Socket )
+    {
+        tcp::no_delay no_delay_before;
+        tcp::socket::receive_buffer_size receive_before;
+        socket.get_option(no_delay_before);
+        socket.get_option(receive_before);
+
+        error_code ec;
+        Socket_Options().apply_before_connect(socket, ec);
+        Socket_Options().apply(socket, ec);
+        BOOST_TEST( !ec );
+
+        tcp::no_delay no_delay_after;
+        tcp::socket::receive_buffer_size receive_after;
+        socket.get_option(no_delay_after);
+        socket.get_option(receive_after);
+        BOOST_TEST( no_delay_after.value() == no_delay_before.value() );
+        BOOST_TEST( receive_after.value() == receive_before.value() );
+    }
+
+    BOOST_FIXTURE_TEST_CASE( check_options_are_applied, An_Open_Socket )
+    {
+        Socket_Options options;
+        options.no_delay = true;
+        options.keep_alive = true;
+        options.receive_buffer_size = 64 * 1024;
+        options.send_buffer_size = 64 * 1024;
+
+        error_code ec;
+        options.apply_before_connect(socket, ec);
+        options.apply(socket, ec);
+        BOOST_TEST( !ec );
+
+        tcp::no_delay no_delay;
+        tcp::socket::keep_alive keep_alive;
+        tcp::socket::receive_buffer_size receive_size;
+        tcp::socket::send_buffer_size send_size;
+        socket.get_option(no_delay);
+        socket.get_option(keep_alive);
+        socket.get_option(receive_size);
+        socket.get_option(send_size);
+
+        BOOST_TEST( no_delay.value() );
+        BOOST_TEST( keep_alive.value() );
+        // Some kernels double the requested size for bookkeeping.
+        BOOST_TEST( receive_size.value() >= options.receive_buffer_size );
+        BOOST_TEST( send_size.value() >= options.send_buffer_size );
+    }
+
+    BOOST_FIXTURE_TEST_CASE( check_int_socket_option_is_set, An_Open_Socket )
+    {
+        error_code ec;
+        socket.set_option(net::Int_Socket_Option<SOL_SOCKET, SO_RCVLOWAT>(16), ec);
+        BOOST_TEST( !ec );
+
+        int value = 0;
+        socklen_t size = sizeof(value);
+        ::getsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVLOWAT, &value, &size);
+        BOOST_TEST( value == 16 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_tuned_client_and_server_can_send_and_receive )
+    {
+        Socket_Options options;
+        options.no_delay = true;
+        options.quick_ack = true;
+        options.receive_buffer_size = 128 * 1024;
+        options.send_buffer_size = 128 * 1024;
+
+        auto io_service = make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual);
+        Tcp_Server s(Tcp_Server::Role_t::Echo, port_int, io_service, options);
+        Tcp client("localhost", port_str, io_service, options);
+
+        const string str = "hello\n";
+        error_code ec;
+        BOOST_TEST( client.send(str, ec).get() == str.size() );
+        BOOST_TEST( *client.receive(str.size(), ec).get() == str );
+
+        // A second exchange runs after quick_ack was re-applied by the first receive.
+        BOOST_TEST( client.send(str, ec).get() == str.size() );
+        BOOST_TEST( *client.receive(str.size(), ec).get() == str );
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+#define BOOST_TEST_DYN_LINK
+
+#include "io_service_manager.h"
+#include "tcp_pipeline.h"
+#include "servers/tcp_server.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using boost::system::system_error;
+
+using net::Io_Service_Manager;
+using net::Tcp;
+using net::Tcp_Pipeline;
+using net::Tcp_Server;
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+static const int port_int = 9014;
+static const char* port_str = "9014";
+
+struct A_Pipeline_To_An_Echo_Server
+{
+    A_Pipeline_To_An_Echo_Server()
+        : io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual, 2)),
+          s(Tcp_Server::Role_t::Echo, port_int, io_service),
+          pipeline("localhost", port_str, io_service)
+    {}
+
+    shared_ptr<Io_Service_Manager> io_service;
+    Tcp_Server s;
+    Tcp_Pipeline pipeline;
+};
+
+BOOST_FIXTURE_TEST_SUITE( tcp_pipeline_suite, A_Pipeline_To_An_Echo_Server )
+
+    BOOST_AUTO_TEST_CASE( check_request_receives_its_response )
+    {
+        const string str = "hello\n";
+
+        BOOST_TEST( *pipeline.request(str, "\n").get() == str );
+        BOOST_TEST( pipeline.outstanding() == 0 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_outstanding_responses_match_in_order )
+    {
+        vector<string> requests;
+        for (int i = 0; i < 100; ++i)
+        {
+            requests.push_back("request " + std::to_string(i) + "\n");
+        }
+
+        vector<Tcp_Pipeline::Response_Return_t> responses;
+        for (const auto& request : requests)
+        {
+            responses.push_back(pipeline.request(request, "\n"));
+        }
+
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            BOOST_TEST( *responses[i].get() == requests[i] );
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE( check_sized_responses_match_in_order )
+    {
+        const string first = "one\n";
+        const string second = "three\n";
+
+        auto first_fut = pipeline.request(first, first.size());
+        auto second_fut = pipeline.request(second, second.size());
+
+        BOOST_TEST( *first_fut.get() == first );
+        BOOST_TEST( *second_fut.get() == second );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_concurrent_callers_get_their_own_responses )
+    {
+        const int num_threads = 4;
+        const int requests_per_thread = 50;
+        vector<int> mismatches(num_threads, 0);
+
+        boost::thread_group callers;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            callers.create_thread([this, t, &mismatches] ()
+                {
+                    vector<string> requests;
+                    vector<Tcp_Pipeline::Response_Return_t> responses;
+                    for (int i = 0; i < requests_per_thread; ++i)
+                    {
+                        requests.push_back(std::to_string(t) + ":" + std::to_string(i) + "\n");
+                    }
+                    for (const auto& request : requests)
+                    {
+                        responses.push_back(pipeline.request(request, "\n"));
+                    }
+                    for (size_t i = 0; i < requests.size(); ++i)
+                    {
+                        if (*responses[i].get() != requests[i])
+                        {
+                            ++mismatches[t];
+                        }
+                    }
+                }
+            );
+        }
+        callers.join_all();
+
+        BOOST_TEST( (mismatches == vector<int>(num_threads, 0)) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_requests_fail_once_connection_closes )
+    {
+        const string str = "no delimiter";
+
+        auto response = pipeline.request(str, "\n");
+        boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+        pipeline.close();
+
+        BOOST_CHECK_THROW( response.get(), system_error );
+        BOOST_TEST( !pipeline.is_open() );
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
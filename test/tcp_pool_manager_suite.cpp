@@ -0,0 +1,153 @@
+#define BOOST_TEST_DYN_LINK
+
+#include "logger.h"
+#include "tcp_pool_manager.h"
+#include "servers/tcp_server.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "boost_config.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using boost::posix_time::milliseconds;
+using boost::posix_time::seconds;
+using boost::system::error_code;
+
+using net::Tcp_Pool;
+using net::Tcp_Pool_Manager;
+using net::Tcp_Server;
+
+using std::string;
+
+static const int port_int = 9012;
+static const char* port_str = "9012";
+
+// The pools are keyed by host name so each of these is a separate pool to the same server.
+static const char* host_a = "localhost";
+static const char* host_b = "127.0.0.1";
+static const char* host_c = "127.0.0.2";
+
+struct A_Tcp_Pool_Manager_Connected_To_Local_Server
+{
+    A_Tcp_Pool_Manager_Connected_To_Local_Server()
+        : s(Tcp_Server::Role_t::Echo, port_int),
+        manager(Tcp_Pool_Manager::create(seconds(10), 2, 2))
+    {}
+
+    Tcp_Server s;
+    std::shared_ptr<Tcp_Pool_Manager> manager;
+};
+
+BOOST_FIXTURE_TEST_SUITE( tcp_pool_manager_suite, A_Tcp_Pool_Manager_Connected_To_Local_Server )
+
+    BOOST_AUTO_TEST_CASE( check_pools_are_keyed_by_host_and_service )
+    {
+        auto pool = manager->get_pool(host_a, port_str);
+
+        BOOST_TEST( manager->get_pool(host_a, port_str) == pool );
+        BOOST_TEST( manager->get_pool(host_b, port_str) != pool );
+        BOOST_TEST( manager->get_pool(host_a, "9013") != pool );
+        BOOST_TEST( manager->pool_count() == 3 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_guards_to_different_hosts_can_send_and_receive )
+    {
+        const string str = "hello\n";
+        error_code ec;
+
+        auto tcpg1 = manager->get(host_a, port_str);
+        auto tcpg2 = manager->get(host_b, port_str);
+
+        BOOST_TEST( tcpg1->send(str, ec).get() == str.size() );
+        BOOST_TEST( tcpg2->send(str, ec).get() == str.size() );
+        BOOST_TEST( *tcpg1->receive(str.size(), ec).get() == str );
+        BOOST_TEST( *tcpg2->receive(str.size(), ec).get() == str );
+        BOOST_TEST( manager->open_count() == 2 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_budget_evicts_least_recently_used_idle_connection )
+    {
+        {
+            auto tcpg = manager->get(host_a, port_str);
+        }
+        {
+            auto tcpg = manager->get(host_b, port_str);
+        }
+        BOOST_TEST( manager->open_count() == 2 );
+
+        // host_a's idle connection is the oldest so it makes room for host_c.
+        auto tcpg = manager->get(host_c, port_str);
+        BOOST_TEST( tcpg->is_open() );
+        BOOST_TEST( manager->get_pool(host_a, port_str)->idle_count() == 0 );
+        BOOST_TEST( manager->get_pool(host_b, port_str)->idle_count() == 1 );
+        BOOST_TEST( manager->open_count() == 2 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_caller_waiting_on_budget_gets_returned_slot )
+    {
+        boost::future<Tcp_Pool::Tcp_Guard> waiting;
+
+        {
+            auto tcpg1 = manager->get(host_a, port_str);
+            auto tcpg2 = manager->get(host_a, port_str);
+            waiting = manager->async_get(host_b, port_str);
+
+            boost::this_thread::sleep(milliseconds(20));
+            BOOST_TEST( !waiting.is_ready() );
+        }
+
+        auto tcpg = waiting.get();
+        BOOST_TEST( tcpg->is_open() );
+        BOOST_TEST( manager->open_count() == 2 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_slots_freed_while_callers_queue_are_not_lost )
+    {
+        const int num_threads = 4;
+        const int gets_per_thread = 50;
+        std::atomic<int> timeouts(0);
+
+        // Every guard closes its connection so each return frees a budget slot for callers
+        // on the other hosts, racing them as they queue.
+        boost::thread_group callers;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            callers.create_thread([this, t, &timeouts] ()
+                {
+                    const char* host = t % 2 ? host_a : host_b;
+                    for (int i = 0; i < gets_per_thread; ++i)
+                    {
+                        try
+                        {
+                            auto tcpg = manager->get_pool(host, port_str)->async_get(seconds(5)).get();
+                            tcpg->close();
+                        }
+                        catch (boost::system::system_error&)
+                        {
+                            ++timeouts;
+                        }
+                    }
+                }
+            );
+        }
+        callers.join_all();
+
+        BOOST_TEST( timeouts == 0 );
+        BOOST_TEST( manager->open_count() == 0 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_per_host_limit_applies )
+    {
+        auto pool = manager->get_pool(host_a, port_str);
+        auto tcpg1 = pool->get();
+        auto tcpg2 = pool->get();
+
+        auto waiting = pool->async_get(milliseconds(20));
+        BOOST_CHECK_THROW( waiting.get(), boost::system::system_error );
+        BOOST_TEST( pool->open_count() == 2 );
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -13,10 +13,12 @@
 using boost::posix_time::milliseconds;
 using boost::system::error_code;
 
+using net::Io_Service_Manager;
 using net::Tcp;
 using net::Tcp_Pool;
 using net::Tcp_Server;
 
+using std::make_shared;
 using std::shared_ptr;
 using std::string;
 
@@ -34,6 +36,19 @@ struct A_Tcp_Pool_Connected_To_Local_Server
     shared_ptr<Tcp_Pool> tcp_pool;
 };
 
+struct A_Shared_Tcp_Pool_Connected_To_Local_Server
+{
+    A_Shared_Tcp_Pool_Connected_To_Local_Server()
+        : io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual)),
+        s(Tcp_Server::Role_t::Echo, port_int, io_service),
+        tcp_pool(Tcp_Pool::create("localhost", port_str, milliseconds(10), io_service))
+    {}
+
+    shared_ptr<Io_Service_Manager> io_service;
+    Tcp_Server s;
+    shared_ptr<Tcp_Pool> tcp_pool;
+};
+
 BOOST_FIXTURE_TEST_SUITE( tcp_pool_suite, A_Tcp_Pool_Connected_To_Local_Server )
 
     BOOST_AUTO_TEST_CASE( check_tcp_pool_gets_open_connection )
@@ -106,6 +121,164 @@ BOOST_FIXTURE_TEST_SUITE( tcp_pool_suite, A_Tcp_Pool_Connected_To_Local_Server )
         BOOST_TEST( *recv2 == str2 );
     }
 
+    BOOST_AUTO_TEST_CASE( check_async_get_returns_open_connection )
+    {
+        auto tcpg = tcp_pool->async_get().get();
+        const string str = "hello\n";
+        error_code ec;
+
+        BOOST_TEST( tcpg->is_open() );
+        BOOST_TEST( tcpg->send(str, ec).get() == str.size() );
+        BOOST_TEST( *tcpg->receive(str.size(), ec).get() == str );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_bounded_pool_waits_for_returned_connection )
+    {
+        tcp_pool->set_max_connections(1);
+        boost::future<Tcp_Pool::Tcp_Guard> waiting;
+
+        {
+            auto tcpg = tcp_pool->get();
+            waiting = tcp_pool->async_get();
+
+            boost::this_thread::sleep(milliseconds(20));
+            BOOST_TEST( !waiting.is_ready() );
+        }
+
+        auto tcpg = waiting.get();
+        BOOST_TEST( tcpg->is_open() );
+        BOOST_TEST( tcp_pool->open_count() == 1 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_closed_connection_frees_slot_for_waiter )
+    {
+        tcp_pool->set_max_connections(1);
+        boost::promise<bool> got_connection;
+
+        {
+            auto tcpg = tcp_pool->get();
+            tcp_pool->async_get([&got_connection] (const error_code& ec, Tcp_Pool::Tcp_Guard g)
+                {
+                    got_connection.set_value(!ec and g and g->is_open());
+                }
+            );
+            tcpg->close();
+        }
+
+        BOOST_TEST( got_connection.get_future().get() );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_waiter_times_out )
+    {
+        tcp_pool->set_max_connections(1);
+        auto tcpg = tcp_pool->get();
+
+        auto waiting = tcp_pool->async_get(milliseconds(20));
+        BOOST_CHECK_THROW( waiting.get(), boost::system::system_error );
+
+        // The timed out waiter doesn't take the returned connection.
+        BOOST_TEST( tcp_pool->open_count() == 1 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_lifo_policy_reuses_most_recent_connection )
+    {
+        auto pool = Tcp_Pool::create("localhost", port_str, boost::posix_time::seconds(10));
+        pool->set_reuse_policy(Tcp_Pool::Reuse_Policy_t::Lifo);
+
+        Tcp* older = nullptr;
+        Tcp* younger = nullptr;
+        {
+            auto tcpg1 = pool->get();
+            auto tcpg2 = pool->get();
+            // Guards are destroyed in reverse order so tcpg1 goes back to the pool last.
+            older = &*tcpg2;
+            younger = &*tcpg1;
+        }
+
+        BOOST_TEST( pool->idle_count() == 2 );
+        BOOST_TEST( &*pool->get() == younger );
+        BOOST_TEST( &*pool->get() == younger );
+
+        pool->set_reuse_policy(Tcp_Pool::Reuse_Policy_t::Fifo);
+        BOOST_TEST( &*pool->get() == older );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_min_idle_warms_and_replenishes_connections )
+    {
+        auto pool = Tcp_Pool::create("localhost", port_str, boost::posix_time::seconds(10));
+        auto wait_for_idle = [&pool] (size_t count)
+        {
+            for (int i = 0; i < 100 and pool->idle_count() < count; ++i)
+            {
+                boost::this_thread::sleep(milliseconds(10));
+            }
+            return pool->idle_count();
+        };
+
+        pool->set_min_idle(2);
+        BOOST_TEST( wait_for_idle(2) == 2 );
+
+        auto tcpg = pool->get();
+        BOOST_TEST( tcpg->is_open() );
+        BOOST_TEST( wait_for_idle(2) == 2 );
+        BOOST_TEST( pool->open_count() == 3 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_connections_at_min_idle_dont_expire )
+    {
+        tcp_pool->set_min_idle(1);
+        for (int i = 0; i < 100 and tcp_pool->idle_count() < 1; ++i)
+        {
+            boost::this_thread::sleep(milliseconds(10));
+        }
+
+        // The pool's timeout is 10ms.
+        boost::this_thread::sleep(milliseconds(50));
+        BOOST_TEST( tcp_pool->idle_count() == 1 );
+        BOOST_TEST( tcp_pool->open_count() == 1 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_connection_closed_by_peer_is_discarded_on_checkout )
+    {
+        const int restart_port_int = 9010;
+        const char* restart_port_str = "9010";
+        auto pool = Tcp_Pool::create("localhost", restart_port_str, boost::posix_time::seconds(10));
+
+        {
+            Tcp_Server restarting(Tcp_Server::Role_t::Echo, restart_port_int);
+            auto tcpg = pool->get();
+        }
+        Tcp_Server restarted(Tcp_Server::Role_t::Echo, restart_port_int);
+        boost::this_thread::sleep(milliseconds(20));
+        BOOST_TEST( pool->idle_count() == 1 );
+
+        auto tcpg = pool->get();
+        const string str = "hello\n";
+        error_code ec;
+        BOOST_TEST( tcpg->send(str, ec).get() == str.size() );
+        BOOST_TEST( *tcpg->receive(str.size(), ec).get() == str );
+        BOOST_TEST( pool->open_count() == 1 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_sweeper_discards_connections_closed_by_peer )
+    {
+        const int restart_port_int = 9011;
+        const char* restart_port_str = "9011";
+        // Sweeps are rounded up to the idle timers' 1/16th of the timeout.
+        auto pool = Tcp_Pool::create("localhost", restart_port_str, milliseconds(800));
+        pool->set_sweep_interval(milliseconds(20));
+
+        {
+            Tcp_Server restarting(Tcp_Server::Role_t::Echo, restart_port_int);
+            auto tcpg = pool->get();
+        }
+        BOOST_TEST( pool->idle_count() == 1 );
+
+        boost::this_thread::sleep(milliseconds(200));
+        BOOST_TEST( pool->idle_count() == 0 );
+        BOOST_TEST( pool->open_count() == 0 );
+    }
+
     // XXX These tests require checking pool internals?
 
     BOOST_AUTO_TEST_CASE( check_closed_guard_doesnt_return_to_pool )
@@ -114,6 +287,15 @@ BOOST_FIXTURE_TEST_SUITE( tcp_pool_suite, A_Tcp_Pool_Connected_To_Local_Server )
 
     BOOST_AUTO_TEST_CASE( check_cached_connection_expires_after_timeout )
     {
+        {
+            auto tcpg = tcp_pool->get();
+        }
+        BOOST_TEST( tcp_pool->idle_count() == 1 );
+
+        // The pool's timeout is 10ms.
+        boost::this_thread::sleep(milliseconds(50));
+        BOOST_TEST( tcp_pool->idle_count() == 0 );
+        BOOST_TEST( tcp_pool->open_count() == 0 );
     }
 
     BOOST_AUTO_TEST_CASE( check_tcp_pool_gets_existing_cached_connection )
@@ -125,3 +307,45 @@ BOOST_FIXTURE_TEST_SUITE( tcp_pool_suite, A_Tcp_Pool_Connected_To_Local_Server )
     }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE( shared_tcp_pool_suite, A_Shared_Tcp_Pool_Connected_To_Local_Server )
+
+    BOOST_AUTO_TEST_CASE( check_guards_on_shared_service_can_send_and_receive )
+    {
+        auto tcpg1 = tcp_pool->get();
+        auto tcpg2 = tcp_pool->get();
+        const string str = "hello\n";
+        error_code ec;
+
+        BOOST_TEST( tcpg1->send(str, ec).get() == str.size() );
+        BOOST_TEST( tcpg2->send(str, ec).get() == str.size() );
+
+        BOOST_TEST( *tcpg1->receive(str.size(), ec).get() == str );
+        BOOST_TEST( *tcpg2->receive(str.size(), ec).get() == str );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_async_get_reuses_returned_connection )
+    {
+        {
+            auto tcpg = tcp_pool->async_get().get();
+            BOOST_TEST( tcpg->is_open() );
+        }
+
+        auto tcpg = tcp_pool->async_get().get();
+        BOOST_TEST( tcpg->is_open() );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_returned_connections_expire_on_shared_service )
+    {
+        {
+            auto tcpg = tcp_pool->get();
+            BOOST_TEST( tcpg->is_open() );
+        }
+
+        // Let the deadline timer fire on the shared service.
+        boost::this_thread::sleep(milliseconds(50));
+
+        BOOST_TEST( io_service->is_running() );
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
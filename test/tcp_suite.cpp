@@ -8,6 +8,7 @@
 #include "boost_config.h"
 #include <boost/asio.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <boost/thread/future.hpp>
 
 using boost::future;
@@ -15,9 +16,11 @@ using boost::asio::buffer;
 using boost::asio::const_buffer;
 using boost::system::error_code;
 
+using net::Io_Service_Manager;
 using net::Tcp;
 using net::Tcp_Server;
 
+using std::make_shared;
 using std::shared_ptr;
 using std::string;
 
@@ -48,6 +51,32 @@ struct A_Connected_Tcp_Client : public A_Running_Tcp_Echo_Server
     std::vector<const_buffer> send_vector_of_buffers;
 };
 
+struct Clients_On_A_Shared_Io_Service
+{
+    Clients_On_A_Shared_Io_Service()
+        : io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual, 2)),
+          s(Tcp_Server::Role_t::Echo, port_int, io_service),
+          client1("localhost", port_str, io_service),
+          client2("localhost", port_str, io_service)
+    {}
+
+    shared_ptr<Io_Service_Manager> io_service;
+    Tcp_Server s;
+    Tcp client1;
+    Tcp client2;
+};
+
+struct A_Shared_Io_Service_With_A_Server
+{
+    A_Shared_Io_Service_With_A_Server()
+        : io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual)),
+          s(Tcp_Server::Role_t::Echo, port_int, io_service)
+    {}
+
+    shared_ptr<Io_Service_Manager> io_service;
+    Tcp_Server s;
+};
+
 BOOST_AUTO_TEST_SUITE( tcp_suite )
 
     BOOST_FIXTURE_TEST_CASE( check_client_can_connect, A_Connected_Tcp_Client )
@@ -125,6 +154,61 @@ BOOST_AUTO_TEST_SUITE( tcp_suite )
 
     BOOST_AUTO_TEST_SUITE_END() // client_sending_messages
 
+    BOOST_FIXTURE_TEST_SUITE( write_coalescing, A_Connected_Tcp_Client )
+        error_code ec;
+        shared_ptr<string> response;
+
+        BOOST_AUTO_TEST_CASE( check_coalesced_sends_flush_at_threshold )
+        {
+            std::vector<string> pieces(32, "a\n");
+            client.enable_write_coalescing(pieces.size() * 2, boost::posix_time::seconds(10));
+
+            std::vector<Tcp::Send_Return_t> send_futs;
+            for (const string& piece : pieces)
+            {
+                send_futs.push_back(client.send(piece, ec));
+            }
+
+            // Every caller gets the size of its own send.
+            for (auto& send_fut : send_futs)
+            {
+                BOOST_TEST( send_fut.get() == 2 );
+            }
+
+            string expected;
+            for (const string& piece : pieces)
+            {
+                expected += piece;
+            }
+
+            response = client.receive(expected.size(), ec).get();
+            BOOST_TEST( (*response == expected) );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_coalesced_send_flushes_after_delay )
+        {
+            client.enable_write_coalescing(1 << 20, boost::posix_time::milliseconds(10));
+
+            BOOST_TEST( (client.send(send_string, ec).get() == send_string.size()) );
+
+            response = client.receive(string("\n"), ec).get();
+            BOOST_TEST( (*response == send_string) );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_disabling_coalescing_flushes_pending_sends )
+        {
+            client.enable_write_coalescing(1 << 20, boost::posix_time::seconds(10));
+            auto send_fut = client.send(send_string, ec);
+            client.disable_write_coalescing();
+
+            BOOST_TEST( (send_fut.get() == send_string.size()) );
+
+            // Later sends are written straight away.
+            BOOST_TEST( (client.send(send_string, ec).get() == send_string.size()) );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END() // write_coalescing
+
     BOOST_FIXTURE_TEST_SUITE( client_receiving_messages, A_Connected_Tcp_Client )
             error_code send_ec;
             Tcp::Send_Return_t send_fut;
@@ -187,6 +271,327 @@ BOOST_AUTO_TEST_SUITE( tcp_suite )
                 BOOST_TEST( (*response == send_string.substr(0, loc+1)) );
             }
 
+            BOOST_AUTO_TEST_CASE( check_receive_size_after_pattern_uses_buffered_data )
+            {
+                sent_size = client.send(send_string, send_ec).get();
+                BOOST_TEST( !send_ec );
+
+                string pattern = ",";
+                size_t loc = send_string.find(pattern);
+                client.receive(pattern, read_ec).get();
+                response = client.receive(send_string.size() - loc - 1, read_ec).get();
+
+                BOOST_TEST( !read_ec );
+                BOOST_TEST( (*response == send_string.substr(loc + 1)) );
+            }
+
+            BOOST_AUTO_TEST_CASE( check_receive_view_size )
+            {
+                sent_size = client.send(send_string, send_ec).get();
+                BOOST_TEST( !send_ec );
+
+                size_t receive_size = 5;
+                auto view = client.receive_view(receive_size, read_ec).get();
+
+                BOOST_TEST( !read_ec );
+                BOOST_TEST( view->size() == receive_size );
+                BOOST_TEST( (view->str() == send_string.substr(0, receive_size)) );
+            }
+
+            BOOST_AUTO_TEST_CASE( check_receive_view_string_pattern )
+            {
+                sent_size = client.send(send_string, send_ec).get();
+                BOOST_TEST( !send_ec );
+
+                string pattern = ",";
+                size_t loc = send_string.find(pattern);
+                auto view = client.receive_view(pattern, read_ec).get();
+
+                BOOST_TEST( !read_ec );
+                BOOST_TEST( (view->str() == send_string.substr(0, loc+1)) );
+            }
+
+            BOOST_AUTO_TEST_CASE( check_released_view_is_consumed )
+            {
+                sent_size = client.send(send_string, send_ec).get();
+                BOOST_TEST( !send_ec );
+
+                size_t receive_size = 5;
+                client.receive_view(receive_size, read_ec).get().reset();
+                response = client.receive(send_string.size() - receive_size, read_ec).get();
+
+                BOOST_TEST( (*response == send_string.substr(receive_size)) );
+            }
+
+            BOOST_AUTO_TEST_CASE( check_receive_waits_for_held_view )
+            {
+                sent_size = client.send(send_string, send_ec).get();
+                BOOST_TEST( !send_ec );
+
+                size_t receive_size = 5;
+                auto view = client.receive_view(receive_size, read_ec).get();
+                recv_fut = client.receive(send_string.size() - receive_size, read_ec);
+
+                // The view still points at valid data while the next receive is queued.
+                boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+                BOOST_TEST( !recv_fut.is_ready() );
+                BOOST_TEST( (view->str() == send_string.substr(0, receive_size)) );
+
+                view.reset();
+                BOOST_TEST( (*recv_fut.get() == send_string.substr(receive_size)) );
+            }
+
     BOOST_AUTO_TEST_SUITE_END() // client_receiving_messages
 
+    BOOST_FIXTURE_TEST_SUITE( client_handlers, A_Connected_Tcp_Client )
+
+        BOOST_AUTO_TEST_CASE( check_send_with_handler )
+        {
+            boost::promise<size_t> sent;
+            client.send(send_string, [&sent] (const error_code& ec, size_t len)
+                {
+                    BOOST_TEST( !ec );
+                    sent.set_value(len);
+                }
+            );
+
+            BOOST_TEST( (sent.get_future().get() == send_string.size()) );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_receive_size_with_handler )
+        {
+            boost::promise<shared_ptr<string>> received;
+            client.send(send_string, [] (const error_code&, size_t) {});
+
+            size_t receive_size = 5;
+            client.receive(receive_size, [&received] (const error_code& ec, shared_ptr<string> data)
+                {
+                    BOOST_TEST( !ec );
+                    received.set_value(data);
+                }
+            );
+
+            BOOST_TEST( (*received.get_future().get() == send_string.substr(0, receive_size)) );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_receive_pattern_with_handler )
+        {
+            boost::promise<shared_ptr<string>> received;
+            client.send(send_string, [] (const error_code&, size_t) {});
+
+            client.receive(string("\n"), [&received] (const error_code& ec, shared_ptr<string> data)
+                {
+                    BOOST_TEST( !ec );
+                    received.set_value(data);
+                }
+            );
+
+            BOOST_TEST( (*received.get_future().get() == send_string) );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END() // client_handlers
+
+    BOOST_FIXTURE_TEST_SUITE( client_coroutines, A_Connected_Tcp_Client )
+
+        BOOST_AUTO_TEST_CASE( check_sequential_send_and_receive )
+        {
+            Io_Service_Manager coroutine_service(Io_Service_Manager::Behavior_t::Perpetual);
+            boost::promise<string> received;
+
+            boost::asio::spawn(coroutine_service.get(), [&] (boost::asio::yield_context yield)
+                {
+                    BOOST_TEST( (client.send(send_string, yield) == send_string.size()) );
+
+                    auto start = client.receive(5, yield);
+                    auto rest = client.receive(string("\n"), yield);
+                    received.set_value(*start + *rest);
+                }
+            );
+
+            BOOST_TEST( (received.get_future().get() == send_string) );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_send_buffers_in_coroutine )
+        {
+            Io_Service_Manager coroutine_service(Io_Service_Manager::Behavior_t::Perpetual);
+            boost::promise<size_t> sent;
+
+            boost::asio::spawn(coroutine_service.get(), [&] (boost::asio::yield_context yield)
+                {
+                    error_code ec;
+                    sent.set_value(client.send(send_vector_of_buffers, yield[ec]));
+                    BOOST_TEST( !ec );
+                }
+            );
+
+            BOOST_TEST( (sent.get_future().get() ==
+                         send_string.size() * send_vector_of_buffers.size()) );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END() // client_coroutines
+
+    BOOST_FIXTURE_TEST_SUITE( shared_io_service, Clients_On_A_Shared_Io_Service )
+
+        BOOST_AUTO_TEST_CASE( check_clients_can_connect )
+        {
+            BOOST_TEST( client1.is_open() );
+            BOOST_TEST( client2.is_open() );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_clients_can_independently_send_and_receive )
+        {
+            const string str1 = "hello\n";
+            const string str2 = "world\n";
+            error_code ec1, ec2;
+
+            BOOST_TEST( client1.send(str1, ec1).get() == str1.size() );
+            BOOST_TEST( client2.send(str2, ec2).get() == str2.size() );
+
+            BOOST_TEST( *client2.receive(str2.size(), ec2).get() == str2 );
+            BOOST_TEST( *client1.receive(str1.size(), ec1).get() == str1 );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_send_progresses_while_receive_is_outstanding )
+        {
+            const string str = "hello\n";
+            error_code ec;
+
+            // The receive waits on the echo of a send made after it.
+            auto recv_fut = client1.receive(string("\n"), ec);
+            BOOST_TEST( client1.send(str, ec).get() == str.size() );
+            BOOST_TEST( *recv_fut.get() == str );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_queued_receives_complete_in_order )
+        {
+            const string str = "one\ntwo\nthree\n";
+            error_code ec;
+
+            auto first = client1.receive(string("\n"), ec);
+            auto second = client1.receive(string("\n"), ec);
+            auto third = client1.receive(string("\n"), ec);
+            client1.send(str, ec);
+
+            BOOST_TEST( *first.get() == "one\n" );
+            BOOST_TEST( *second.get() == "two\n" );
+            BOOST_TEST( *third.get() == "three\n" );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_closing_a_client_leaves_service_running )
+        {
+            client1.close();
+
+            BOOST_TEST( !client1.is_open() );
+            BOOST_TEST( client2.is_open() );
+            BOOST_TEST( io_service->is_running() );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_stopping_server_leaves_service_running )
+        {
+            s.stop();
+
+            BOOST_TEST( io_service->is_running() );
+        }
+
+        // A reset peer fails the outstanding send and receive together, so both strands
+        // handle the disconnect at the same time.
+        BOOST_AUTO_TEST_CASE( check_disconnect_on_both_strands_closes_once )
+        {
+            using boost::asio::ip::tcp;
+
+            auto workers = make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual, 4);
+            tcp::acceptor acceptor(io_service->get(), tcp::endpoint(tcp::v4(), 9045));
+
+            for (int i = 0; i < 10; ++i)
+            {
+                Tcp client("localhost", "9045", workers);
+                tcp::socket peer(io_service->get());
+                acceptor.accept(peer);
+
+                // The peer never reads, so the send stays in flight once the buffers fill.
+                const string large(16 * 1024 * 1024, 'x');
+                boost::promise<error_code> send_prom, recv_prom;
+                client.send(large, [&send_prom] (const error_code& ec, size_t)
+                    { send_prom.set_value(ec); }
+                );
+                client.receive(string("\n"), [&recv_prom] (const error_code& ec, shared_ptr<string>)
+                    { recv_prom.set_value(ec); }
+                );
+                boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+
+                // Closing with a zero linger resets the connection.
+                peer.set_option(tcp::socket::linger(true, 0));
+                peer.close();
+
+                error_code send_ec = send_prom.get_future().get();
+                error_code recv_ec = recv_prom.get_future().get();
+                BOOST_TEST( (send_ec == boost::asio::error::connection_reset
+                             or send_ec == boost::asio::error::broken_pipe) );
+                BOOST_TEST( (recv_ec == boost::asio::error::connection_reset
+                             or recv_ec == boost::asio::error::eof) );
+                BOOST_TEST( !client.is_open() );
+            }
+        }
+
+        BOOST_AUTO_TEST_CASE( check_view_outliving_its_connection )
+        {
+            const string message = "hello, world!\n";
+            error_code ec;
+            boost::promise<error_code> recv_prom;
+            shared_ptr<const Tcp::Receive_View> view;
+            {
+                Tcp client("localhost", port_str, io_service);
+                client.send(message, ec).get();
+                view = client.receive_view(5, ec).get();
+                client.receive(string("\n"), [&recv_prom] (const error_code& ec, shared_ptr<string>)
+                    { recv_prom.set_value(ec); }
+                );
+            }
+
+            // Destroying the connection fails the receive queued behind the view, without
+            // waiting for it to be released.
+            auto recv_fut = recv_prom.get_future();
+            BOOST_TEST( recv_fut.is_ready() );
+            BOOST_TEST( !!recv_fut.get() );
+
+            BOOST_TEST( (view->str() == message.substr(0, 5)) );
+            view.reset();
+        }
+
+    BOOST_AUTO_TEST_SUITE_END() // shared_io_service
+
+    BOOST_FIXTURE_TEST_SUITE( async_connect, A_Shared_Io_Service_With_A_Server )
+
+        BOOST_AUTO_TEST_CASE( check_async_created_client_can_send_and_receive )
+        {
+            std::unique_ptr<Tcp> client = Tcp::async_create("localhost", port_str, io_service).get();
+            const string str = "hello\n";
+            error_code ec;
+
+            BOOST_TEST( client->is_open() );
+            BOOST_TEST( client->send(str, ec).get() == str.size() );
+            BOOST_TEST( *client->receive(str.size(), ec).get() == str );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_async_create_callback_receives_client )
+        {
+            boost::promise<bool> prom;
+            Tcp::async_create("localhost", port_str, io_service,
+                [&prom] (const error_code& ec, std::unique_ptr<Tcp> client)
+                    { prom.set_value(!ec and client and client->is_open()); }
+            );
+
+            BOOST_TEST( prom.get_future().get() );
+        }
+
+        BOOST_AUTO_TEST_CASE( check_async_create_fails_without_a_listener )
+        {
+            auto fut = Tcp::async_create("localhost", "9044", io_service);
+
+            BOOST_CHECK_THROW( fut.get(), boost::system::system_error );
+            BOOST_TEST( io_service->is_running() );
+        }
+
+    BOOST_AUTO_TEST_SUITE_END() // async_connect
+
 BOOST_AUTO_TEST_SUITE_END()
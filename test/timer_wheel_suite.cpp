@@ -0,0 +1,128 @@
+#define BOOST_TEST_DYN_LINK
+
+#include "io_service_manager.h"
+#include "timer_wheel.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "boost_config.h"
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using boost::posix_time::microsec_clock;
+using boost::posix_time::milliseconds;
+
+using net::Io_Service_Manager;
+using net::Timer_Wheel;
+
+using std::make_shared;
+
+struct A_Timer_Wheel
+{
+    A_Timer_Wheel()
+      : io_service(make_shared<Io_Service_Manager>(Io_Service_Manager::Behavior_t::Perpetual)),
+        wheel(Timer_Wheel::create(io_service, milliseconds(5), 8))
+    {}
+
+    std::shared_ptr<Io_Service_Manager> io_service;
+    std::shared_ptr<Timer_Wheel> wheel;
+};
+
+BOOST_FIXTURE_TEST_SUITE( timer_wheel_suite, A_Timer_Wheel )
+
+    BOOST_AUTO_TEST_CASE( check_timer_fires_after_delay )
+    {
+        boost::promise<Timer_Wheel::Timer_Id_t> fired;
+        auto start = microsec_clock::universal_time();
+
+        auto id = wheel->arm(milliseconds(20), [&fired] (Timer_Wheel::Timer_Id_t id)
+            {
+                fired.set_value(id);
+            }
+        );
+
+        BOOST_TEST( fired.get_future().get() == id );
+        BOOST_TEST( (microsec_clock::universal_time() - start) >= milliseconds(20) );
+        BOOST_TEST( wheel->pending() == 0 );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_timer_longer_than_one_turn_fires )
+    {
+        // 8 slots of 5ms is one turn every 40ms.
+        boost::promise<void> fired;
+        auto start = microsec_clock::universal_time();
+
+        wheel->arm(milliseconds(100), [&fired] (Timer_Wheel::Timer_Id_t) { fired.set_value(); });
+
+        fired.get_future().get();
+        BOOST_TEST( (microsec_clock::universal_time() - start) >= milliseconds(100) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_timers_fire_in_order )
+    {
+        boost::promise<void> done;
+        std::vector<int> order;
+
+        wheel->arm(milliseconds(30), [&] (Timer_Wheel::Timer_Id_t)
+            {
+                order.push_back(2);
+                done.set_value();
+            }
+        );
+        wheel->arm(milliseconds(10), [&] (Timer_Wheel::Timer_Id_t) { order.push_back(1); });
+
+        done.get_future().get();
+        BOOST_TEST( (order == std::vector<int>{ 1, 2 }) );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_cancelled_timer_doesnt_fire )
+    {
+        std::atomic<bool> fired(false);
+
+        auto id = wheel->arm(milliseconds(10), [&fired] (Timer_Wheel::Timer_Id_t) { fired = true; });
+        BOOST_TEST( wheel->pending() == 1 );
+        BOOST_TEST( wheel->cancel(id) );
+        BOOST_TEST( !wheel->cancel(id) );
+        BOOST_TEST( wheel->pending() == 0 );
+
+        boost::this_thread::sleep(milliseconds(30));
+        BOOST_TEST( !fired );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_destroyed_wheel_drops_timers )
+    {
+        std::atomic<bool> fired(false);
+
+        wheel->arm(milliseconds(10), [&fired] (Timer_Wheel::Timer_Id_t) { fired = true; });
+        wheel.reset();
+
+        boost::this_thread::sleep(milliseconds(30));
+        BOOST_TEST( !fired );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_invalid_settings_throw )
+    {
+        BOOST_CHECK_THROW( Timer_Wheel::create(io_service, milliseconds(0)), std::invalid_argument );
+        BOOST_CHECK_THROW( Timer_Wheel::create(io_service, milliseconds(5), 0),
+                           std::invalid_argument );
+    }
+
+    BOOST_AUTO_TEST_CASE( check_shared_wheels_are_shared_per_service_and_tick )
+    {
+        auto other_service = make_shared<Io_Service_Manager>();
+
+        auto shared = Timer_Wheel::shared(io_service, milliseconds(5));
+        BOOST_TEST( Timer_Wheel::shared(io_service, milliseconds(5)) == shared );
+        BOOST_TEST( Timer_Wheel::shared(io_service, milliseconds(10)) != shared );
+        BOOST_TEST( Timer_Wheel::shared(other_service, milliseconds(5)) != shared );
+
+        // The registry doesn't keep a wheel alive.
+        std::weak_ptr<Timer_Wheel> released(shared);
+        shared.reset();
+        BOOST_TEST( released.expired() );
+    }
+
+BOOST_AUTO_TEST_SUITE_END()